@@ -87,6 +87,24 @@ namespace graphene { namespace chain {
                 return end_pos + sizeof(uint64_t);
             }
 
+            std::vector<char> read_raw_block(uint32_t block_num) const {
+                std::vector<char> data;
+                const auto pos = get_block_pos(block_num);
+                if (pos == block_log::npos) {
+                    return data;
+                }
+
+                // each block is followed by its own position, the next block or the end of file follows that
+                const auto end_pos = block_num < protocol::block_header::num_from_id(head_id)
+                    ? get_block_pos(block_num + 1) - sizeof(uint64_t)
+                    : get_mapped_size(block_mapped_file) - sizeof(uint64_t);
+                FC_ASSERT(end_pos > pos && get_uint64(block_mapped_file, end_pos) == pos);
+
+                const auto* ptr = block_mapped_file.data() + pos;
+                data.assign(ptr, ptr + (end_pos - pos));
+                return data;
+            }
+
             signed_block read_head() const {
                 auto pos = get_last_uint64(block_mapped_file);
                 signed_block block;
@@ -284,6 +302,11 @@ namespace graphene { namespace chain {
         return result;
     } FC_LOG_AND_RETHROW() }
 
+    std::vector<char> block_log::read_raw_block_by_num(uint32_t block_num) const { try {
+        detail::read_lock lock(my->mutex);
+        return my->read_raw_block(block_num);
+    } FC_LOG_AND_RETHROW() }
+
     uint64_t block_log::get_block_pos(uint32_t block_num) const {
         detail::read_lock lock(my->mutex);
         return my->get_block_pos(block_num);
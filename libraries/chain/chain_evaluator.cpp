@@ -183,6 +183,7 @@ namespace graphene { namespace chain {
                         auth.regular = *o.regular;
                     }
                 });
+                _db.invalidate_authority_cache(o.account);
             }
 
         }
@@ -1678,6 +1679,7 @@ namespace graphene { namespace chain {
                         auth.regular = auth.active;
                         auth.last_master_update = _db.head_block_time();
                     });
+                    _db.invalidate_authority_cache(op.account);
                     _db.push_virtual_operation(
                         account_sale_operation(op.account,op.account_offer_price,op.buyer,account_seller.name));
                 }
@@ -21,6 +21,7 @@
 #include <graphene/chain/committee_objects.hpp>
 #include <graphene/chain/invite_objects.hpp>
 #include <graphene/chain/paid_subscription_objects.hpp>
+#include <graphene/chain/reward_math.hpp>
 
 #include <fc/smart_ref_impl.hpp>
 
@@ -33,6 +34,8 @@
 #include <csignal>
 #include <cerrno>
 #include <cstring>
+#include <mutex>
+#include <unordered_map>
 
 #define VIRTUAL_SCHEDULE_LAP_LENGTH  ( fc::uint128_t(uint64_t(-1)) )
 #define VIRTUAL_SCHEDULE_LAP_LENGTH2 ( fc::uint128_t::max_value() )
@@ -83,13 +86,6 @@ namespace graphene { namespace chain {
         using std::sig_atomic_t;
         using boost::container::flat_set;
 
-        inline u256 to256(const fc::uint128_t &t) {
-            u256 v(t.hi);
-            v <<= 64;
-            v += t.lo;
-            return v;
-        }
-
         class signal_guard {
             struct sigaction old_hup_action, old_int_action, old_term_action;
 
@@ -188,12 +184,128 @@ namespace graphene { namespace chain {
 
             database &_self;
             evaluator_registry<operation> _evaluator_registry;
+
+            // signees of blocks recovered before applying, see database::prevalidate_block_signee()
+            static const size_t max_block_signees = 10000;
+            std::mutex _block_signees_mutex;
+            std::unordered_map<block_id_type, public_key_type> _block_signees;
+
+            // authorities of accounts converted from shared memory, see database::invalidate_authority_cache()
+            struct cached_account_authority {
+                authority master;
+                authority active;
+                authority regular;
+            };
+
+            authority get_authority(const account_name_type &account, authority cached_account_authority::*role);
+
+            std::mutex _authority_cache_mutex;
+            std::unordered_map<std::string, cached_account_authority> _authority_cache;
+
+            // economic parameters derived from block height and consensus properties, see database::process_funds()
+            struct inflation_split {
+                share_type witness_reward;
+                share_type committee_reward;
+                share_type content_reward;
+                share_type vesting_reward;
+            };
+
+            share_type get_inflation_per_block(uint32_t head_block_number);
+            const inflation_split &get_inflation_split(share_type inflation_per_block, bool consensus_model,
+                int16_t inflation_witness_percent, int16_t inflation_ratio);
+
+            uint32_t _inflation_year = std::numeric_limits<uint32_t>::max();
+            share_type _inflation_supply;
+            share_type _inflation_per_year;
+
+            bool _inflation_split_valid = false;
+            share_type _inflation_split_per_block;
+            bool _inflation_split_consensus_model = false;
+            int16_t _inflation_split_witness_percent = 0;
+            int16_t _inflation_split_ratio = 0;
+            inflation_split _inflation_split;
+
+            // median properties used by database::update_account_bandwidth(), reset by database::update_median_witness_props()
+            bool _bandwidth_reserve_valid = false;
+            int16_t _bandwidth_reserve_percent = 0;
+            share_type _bandwidth_reserve_below;
         };
 
         database_impl::database_impl(database &self)
                 : _self(self), _evaluator_registry(self) {
         }
 
+        authority database_impl::get_authority(const account_name_type &account, authority cached_account_authority::*role) {
+            // transactions can be validated from several read threads
+            std::lock_guard<std::mutex> lock(_authority_cache_mutex);
+            auto itr = _authority_cache.find(std::string(account));
+            if (itr == _authority_cache.end()) {
+                const auto &auth = _self.get<account_authority_object, by_account>(account);
+                itr = _authority_cache.emplace(
+                    std::string(account),
+                    cached_account_authority{authority(auth.master), authority(auth.active), authority(auth.regular)}).first;
+            }
+            return itr->second.*role;
+        }
+
+        share_type database_impl::get_inflation_per_block(uint32_t head_block_number) {
+            uint32_t year = head_block_number / CHAIN_BLOCKS_PER_YEAR;
+            if (year != _inflation_year) {
+                share_type inflation_rate = int64_t( CHAIN_FIXED_INFLATION );
+                uint32_t compounded = 0;
+                // supply only grows, continue compounding from the memo when moving forward
+                if (_inflation_year == std::numeric_limits<uint32_t>::max() || _inflation_year > year) {
+                    _inflation_supply = int64_t( CHAIN_INIT_SUPPLY );
+                    _inflation_per_year = inflation_rate * int64_t( CHAIN_INIT_SUPPLY ) / int64_t( CHAIN_100_PERCENT );
+                    _inflation_supply += _inflation_per_year;
+                } else {
+                    compounded = _inflation_year;
+                }
+                for (; compounded < year; ++compounded) {
+                    _inflation_per_year = ( _inflation_supply * inflation_rate ) / int64_t( CHAIN_100_PERCENT );
+                    _inflation_supply += _inflation_per_year;
+                }
+                _inflation_year = year;
+            }
+            return _inflation_per_year / int64_t( CHAIN_BLOCKS_PER_YEAR );
+        }
+
+        const database_impl::inflation_split &database_impl::get_inflation_split(
+            share_type inflation_per_block, bool consensus_model,
+            int16_t inflation_witness_percent, int16_t inflation_ratio
+        ) {
+            if (_inflation_split_valid &&
+                _inflation_split_per_block == inflation_per_block &&
+                _inflation_split_consensus_model == consensus_model &&
+                _inflation_split_witness_percent == inflation_witness_percent &&
+                _inflation_split_ratio == inflation_ratio
+            ) {
+                return _inflation_split;
+            }
+
+            inflation_split split;
+            if (consensus_model) {
+                split.witness_reward = ( inflation_per_block * inflation_witness_percent ) / CHAIN_100_PERCENT;
+                auto inflation_ratio_reward = inflation_per_block - split.witness_reward;
+                split.committee_reward = ( inflation_ratio_reward * inflation_ratio ) / CHAIN_100_PERCENT;
+                split.content_reward = inflation_ratio_reward - split.committee_reward;
+                split.vesting_reward = 0;
+            } else {
+                split.content_reward = ( inflation_per_block * CHAIN_REWARD_FUND_PERCENT ) / CHAIN_100_PERCENT;
+                split.vesting_reward = ( inflation_per_block * CHAIN_VESTING_FUND_PERCENT ) / CHAIN_100_PERCENT; /// 15% to vesting fund
+                split.committee_reward = ( inflation_per_block * CHAIN_COMMITTEE_FUND_PERCENT ) / CHAIN_100_PERCENT;
+                split.witness_reward = inflation_per_block - split.content_reward - split.vesting_reward - split.committee_reward; /// Remaining 10% to witness pay
+            }
+
+            _inflation_split = split;
+            _inflation_split_per_block = inflation_per_block;
+            _inflation_split_consensus_model = consensus_model;
+            _inflation_split_witness_percent = inflation_witness_percent;
+            _inflation_split_ratio = inflation_ratio;
+            _inflation_split_valid = true;
+            return _inflation_split;
+        }
+
         database::database()
                 : _my(new database_impl(*this)) {
         }
@@ -202,6 +314,21 @@ namespace graphene { namespace chain {
             clear_pending();
         }
 
+        /// An API call runs on one thread, so the wait of its locks is summed there
+        static thread_local int64_t read_lock_wait_us = 0;
+
+        fc::microseconds database::read_lock_wait() {
+            return fc::microseconds(read_lock_wait_us);
+        }
+
+        void database::reset_read_lock_wait() {
+            read_lock_wait_us = 0;
+        }
+
+        void database::add_read_lock_wait(fc::microseconds wait) {
+            read_lock_wait_us += wait.count();
+        }
+
         void database::open(const fc::path &data_dir, const fc::path &shared_mem_dir, uint64_t initial_supply, uint64_t shared_file_size, uint32_t chainbase_flags) {
             try {
                 auto start = fc::time_point::now();
@@ -666,13 +793,21 @@ namespace graphene { namespace chain {
         }
 
         bool database::update_account_bandwidth(const account_object &a, uint32_t trx_size) {
+            return charge_account_bandwidth(a, trx_size * CHAIN_BANDWIDTH_PRECISION);
+        }
+
+        bool database::charge_account_bandwidth(const account_object &a, share_type trx_bandwidth) {
             const auto &props = get_dynamic_global_properties();
             bool has_bandwidth = true;
-            const witness_schedule_object &consensus = get_witness_schedule_object();
+            if (!_my->_bandwidth_reserve_valid) {
+                const witness_schedule_object &consensus = get_witness_schedule_object();
+                _my->_bandwidth_reserve_percent = consensus.median_props.bandwidth_reserve_percent;
+                _my->_bandwidth_reserve_below = consensus.median_props.bandwidth_reserve_below.amount;
+                _my->_bandwidth_reserve_valid = true;
+            }
 
             if (props.total_vesting_shares.amount > 0) {
                 share_type new_bandwidth;
-                share_type trx_bandwidth = trx_size * CHAIN_BANDWIDTH_PRECISION;
                 auto delta_time = (head_block_time() - a.last_bandwidth_update).to_seconds();
                 if (delta_time > CHAIN_BANDWIDTH_AVERAGE_WINDOW_SECONDS) {
                     new_bandwidth = 0;
@@ -697,11 +832,11 @@ namespace graphene { namespace chain {
                 fc::uint128_t account_average_bandwidth(a.average_bandwidth.value);
                 fc::uint128_t max_virtual_bandwidth(props.max_virtual_bandwidth);
 
-                if(account_vshares < consensus.median_props.bandwidth_reserve_below.amount.value){
-                    account_vshares = total_vshares * consensus.median_props.bandwidth_reserve_percent / CHAIN_100_PERCENT / props.bandwidth_reserve_candidates;
+                if(account_vshares < _my->_bandwidth_reserve_below.value){
+                    account_vshares = total_vshares * _my->_bandwidth_reserve_percent / CHAIN_100_PERCENT / props.bandwidth_reserve_candidates;
                 }
                 else{
-                    account_vshares = account_vshares * (CHAIN_100_PERCENT - consensus.median_props.bandwidth_reserve_percent) / CHAIN_100_PERCENT;
+                    account_vshares = account_vshares * (CHAIN_100_PERCENT - _my->_bandwidth_reserve_percent) / CHAIN_100_PERCENT;
                 }
 
                 has_bandwidth = (account_vshares * max_virtual_bandwidth) > (account_average_bandwidth * total_vshares);
@@ -751,9 +886,49 @@ namespace graphene { namespace chain {
                 //   and state can too contain changes of authorizity
             }
 
+            if (!(skip & skip_witness_signature)) {
+                auto signee = prevalidate_block_signee(new_block);
+
+                // witness can change signing key, so the key can be checked here only
+                //   when the state is exactly the state of the block parent
+                with_weak_read_lock([&](){
+                    if (!_pending_tx_session.valid() && new_block.previous == head_block_id()) {
+                        const auto &witness = get_witness(new_block.witness);
+                        FC_ASSERT(
+                            signee == witness.signing_key,
+                            "Block is signed by wrong key",
+                            ("block_num", new_block.block_num())
+                            ("witness", new_block.witness)
+                            ("signee", signee)
+                            ("signing_key", witness.signing_key));
+                    }
+                });
+            }
+
             return skip;
         }
 
+        public_key_type database::prevalidate_block_signee(const signed_block_header &b) {
+            auto id = b.id();
+            {
+                std::lock_guard<std::mutex> lock(_my->_block_signees_mutex);
+                auto itr = _my->_block_signees.find(id);
+                if (itr != _my->_block_signees.end()) {
+                    return itr->second;
+                }
+            }
+
+            public_key_type signee = b.signee();
+
+            std::lock_guard<std::mutex> lock(_my->_block_signees_mutex);
+            // blocks from forks are never applied, so don't let them to accumulate
+            if (_my->_block_signees.size() >= database_impl::max_block_signees) {
+                _my->_block_signees.clear();
+            }
+            _my->_block_signees.emplace(id, signee);
+            return signee;
+        }
+
         void database::_validate_block(const signed_block& new_block, uint32_t skip) {
             uint32_t new_block_num = new_block.block_num();
 
@@ -876,6 +1051,7 @@ namespace graphene { namespace chain {
                                     except = e;
                                 }
                                 if (except) {
+                                    clear_state_caches();
                                     // wlog( "exception thrown while switching forks ${e}", ("e",except->to_detail_string() ) );
                                     // remove the rest of branches.first from the fork_db, those blocks are invalid
                                     while (ritr != branches.first.rend()) {
@@ -915,6 +1091,7 @@ namespace graphene { namespace chain {
                 }
                 catch (const fc::exception &e) {
                     elog("Failed to push new block:\n${e}", ("e", e.to_detail_string()));
+                    clear_state_caches();
                     _fork_db.remove(new_block.id());
                     throw;
                 }
@@ -944,6 +1121,39 @@ namespace graphene { namespace chain {
             FC_CAPTURE_AND_RETHROW((trx))
         }
 
+        std::vector<std::exception_ptr> database::push_transactions(const std::vector<signed_transaction> &trxs, uint32_t skip) {
+            std::vector<std::exception_ptr> results(trxs.size());
+            bool lock_acquired = false;
+            size_t attempted = 0; // transactions which already have their own result
+            try {
+                with_weak_write_lock([&]() {
+                    lock_acquired = true;
+                    detail::with_producing(*this, [&]() {
+                        for (; attempted < trxs.size(); ++attempted) {
+                            const auto &trx = trxs[attempted];
+                            // one rejected transaction doesn't affect the others, as with separate push_transaction() calls
+                            try {
+                                try {
+                                    FC_ASSERT(fc::raw::pack_size(trx) <= (get_dynamic_global_properties().maximum_block_size - 256));
+                                    _push_transaction(trx, skip);
+                                }
+                                FC_CAPTURE_AND_RETHROW((trx))
+                            } catch (...) {
+                                results[attempted] = std::current_exception();
+                            }
+                        }
+                    });
+                });
+            } catch (...) {
+                // without the lock none of the transactions was pushed, otherwise the ones pushed
+                // before the failure keep their results and only the rest get the error
+                for (size_t i = lock_acquired ? attempted : 0; i < results.size(); ++i) {
+                    results[i] = std::current_exception();
+                }
+            }
+            return results;
+        }
+
         void database::_push_transaction(const signed_transaction &trx, uint32_t skip) {
             // If this is the first transaction pushed after applying a block, start a new undo session.
             // This allows us to quickly rewind to the clean state of the head block, in case a new block arrives.
@@ -1020,6 +1230,7 @@ namespace graphene { namespace chain {
                 // re-apply pending transactions in this method.
                 //
                 _pending_tx_session.reset();
+                clear_state_caches();
                 _pending_tx_session = start_undo_session();
 
                 uint64_t postponed_tx_count = 0;
@@ -1062,6 +1273,7 @@ namespace graphene { namespace chain {
                 }
 
                 _pending_tx_session.reset();
+                clear_state_caches();
             });
 
             // We have temporarily broken the invariant that
@@ -1133,6 +1345,7 @@ namespace graphene { namespace chain {
 
                 _fork_db.pop_block();
                 undo();
+                clear_state_caches();
 
                 _popped_tx.insert(_popped_tx.begin(), head_block->transactions.begin(), head_block->transactions.end());
 
@@ -1146,6 +1359,7 @@ namespace graphene { namespace chain {
                        _pending_tx_session.valid());
                 _pending_tx.clear();
                 _pending_tx_session.reset();
+                clear_state_caches();
             }
             FC_CAPTURE_AND_RETHROW()
         }
@@ -1771,6 +1985,7 @@ namespace graphene { namespace chain {
             modify(wso, [&](witness_schedule_object &_wso) {
                 _wso.median_props = median_props;
             });
+            _my->_bandwidth_reserve_valid = false;
 
             modify(get_dynamic_global_properties(), [&](dynamic_global_property_object &_dgpo) {
                 _dgpo.maximum_block_size = median_props.maximum_block_size;
@@ -2034,6 +2249,21 @@ namespace graphene { namespace chain {
                 auth.master = master_authority;
                 auth.last_master_update = head_block_time();
             });
+            invalidate_authority_cache(account.name);
+        }
+
+        void database::invalidate_authority_cache(const account_name_type &account) {
+            std::lock_guard<std::mutex> lock(_my->_authority_cache_mutex);
+            _my->_authority_cache.erase(std::string(account));
+        }
+
+        void database::clear_state_caches() {
+            {
+                std::lock_guard<std::mutex> lock(_my->_authority_cache_mutex);
+                _my->_authority_cache.clear();
+            }
+            // median properties could be reverted by undo
+            _my->_bandwidth_reserve_valid = false;
         }
 
         void database::process_vesting_withdrawals() {
@@ -2339,26 +2569,14 @@ namespace graphene { namespace chain {
 
         void database::process_funds() {
             const auto &props = get_dynamic_global_properties();
-            share_type inflation_rate = int64_t( CHAIN_FIXED_INFLATION );
-            share_type new_supply = int64_t( CHAIN_INIT_SUPPLY );
-            share_type inflation_per_year = inflation_rate * int64_t( CHAIN_INIT_SUPPLY ) / int64_t( CHAIN_100_PERCENT );
-            new_supply += inflation_per_year;
-            int circles = props.head_block_number / CHAIN_BLOCKS_PER_YEAR;
-            if(circles > 0)
-            {
-               for( int itr = 0; itr < circles; ++itr )
-               {
-                  inflation_per_year = ( new_supply * inflation_rate ) / int64_t( CHAIN_100_PERCENT );
-                  new_supply += inflation_per_year;
-               }
-            }
-            share_type inflation_per_block = inflation_per_year / int64_t( CHAIN_BLOCKS_PER_YEAR );
+            share_type inflation_per_block = _my->get_inflation_per_block(props.head_block_number);
 
             if(has_hardfork(CHAIN_HARDFORK_4)){//consensus inflation model
-                auto witness_reward = ( inflation_per_block * props.inflation_witness_percent ) / CHAIN_100_PERCENT;
-                auto inflation_ratio_reward = inflation_per_block - witness_reward;
-                auto committee_reward = ( inflation_ratio_reward * props.inflation_ratio ) / CHAIN_100_PERCENT;
-                auto content_reward = inflation_ratio_reward - committee_reward;
+                const auto &split = _my->get_inflation_split(
+                    inflation_per_block, true, props.inflation_witness_percent, props.inflation_ratio);
+                auto witness_reward = split.witness_reward;
+                auto committee_reward = split.committee_reward;
+                auto content_reward = split.content_reward;
                 inflation_per_block = witness_reward + committee_reward + content_reward;
 
                 modify( props, [&]( dynamic_global_property_object& p )
@@ -2373,22 +2591,15 @@ namespace graphene { namespace chain {
                 push_virtual_operation(witness_reward_operation(cwit.owner,witness_reward_shares));
             }
             else{
-                /*ilog( "Inflation status: props.head_block_number=${h1}, inflation_per_year=${h2}, new_supply=${h3}, inflation_per_block=${h4}",
-                   ("h1",props.head_block_number)("h2", inflation_per_year)("h3",new_supply)("h4",inflation_per_block)
-                );*/
-                auto content_reward = ( inflation_per_block * CHAIN_REWARD_FUND_PERCENT ) / CHAIN_100_PERCENT;
-                auto vesting_reward = ( inflation_per_block * CHAIN_VESTING_FUND_PERCENT ) / CHAIN_100_PERCENT; /// 15% to vesting fund
-                auto committee_reward = ( inflation_per_block * CHAIN_COMMITTEE_FUND_PERCENT ) / CHAIN_100_PERCENT;
-                auto witness_reward = inflation_per_block - content_reward - vesting_reward - committee_reward; /// Remaining 10% to witness pay
+                const auto &split = _my->get_inflation_split(inflation_per_block, false, 0, 0);
+                auto content_reward = split.content_reward;
+                auto vesting_reward = split.vesting_reward;
+                auto committee_reward = split.committee_reward;
+                auto witness_reward = split.witness_reward;
 
                 const auto& cwit = get_witness( props.current_witness );
 
                 inflation_per_block = content_reward + vesting_reward + committee_reward + witness_reward;
-                /*
-                elog( "Final inflation_per_block=${h1}, content_reward=${h2}, committee_reward=${h3}, witness_reward=${h4}, vesting_reward=${h5}",
-                   ("h1",inflation_per_block)("h2", content_reward)("h3",committee_reward)("h4",witness_reward)("h5",vesting_reward)
-                );
-                */
                 modify( props, [&]( dynamic_global_property_object& p )
                 {
                    p.total_vesting_fund += asset( vesting_reward, TOKEN_SYMBOL );
@@ -2402,6 +2613,12 @@ namespace graphene { namespace chain {
             }
         }
 
+        /// Looked up once, the operands of the reward math are written on every claim when it's enabled
+        static fc::logger &reward_math_logger() {
+            static fc::logger logger = fc::logger::get("reward_math");
+            return logger;
+        }
+
 /**
  *  This method reduces the rshare^2 supply and returns the number of tokens are
  *  redeemed.
@@ -2412,16 +2629,12 @@ namespace graphene { namespace chain {
 
                 const auto &props = get_dynamic_global_properties();
 
-                u256 rs(rshares.value);
-                u256 rf(props.total_reward_fund.amount.value);
-                u256 total_rshares = to256(props.total_reward_shares);
-
-                u256 rs2 = to256(rshares.value);
-
-                u256 payout_u256 = (rf * rs2) / total_rshares;
-                FC_ASSERT(payout_u256 <=
-                          u256(uint64_t(std::numeric_limits<int64_t>::max())));
-                uint64_t payout = static_cast< uint64_t >( payout_u256 );
+                uint64_t payout;
+                if (!fast_muldiv(props.total_reward_fund.amount.value, rshares.value, props.total_reward_shares, payout)) {
+                    payout = u256_muldiv(u256(props.total_reward_fund.amount.value), u256(rshares.value), to256(props.total_reward_shares));
+                }
+                fc_dlog(reward_math_logger(), "muldiv: ${a} ${b} ${c}",
+                        ("a", props.total_reward_fund.amount.value)("b", rshares.value)("c", std::string(props.total_reward_shares)));
 
                 modify(props, [&](dynamic_global_property_object &p) {
                     p.total_reward_fund.amount -= payout;
@@ -2437,15 +2650,20 @@ namespace graphene { namespace chain {
 
                 const auto &props = get_dynamic_global_properties();
 
-                u256 rs(rshares.value);
-                u256 rf(props.total_reward_fund.amount.value);
-                u256 total_rshares = to256(props.total_reward_shares);
-                total_rshares += to256(rshares.value);
-
-                u256 payout_u256 = (rf * rs) / total_rshares;
-                FC_ASSERT(payout_u256 <=
-                          u256(uint64_t(std::numeric_limits<int64_t>::max())));
-                uint64_t payout = static_cast< uint64_t >( payout_u256 );
+                uint64_t payout;
+                fc::uint128_t new_total_rshares = props.total_reward_shares + fc::uint128_t(rshares.value);
+                // on overflow of the sum use u256
+                if (new_total_rshares < props.total_reward_shares ||
+                    !fast_muldiv(props.total_reward_fund.amount.value, rshares.value, new_total_rshares, payout)
+                ) {
+                    u256 total_rshares = to256(props.total_reward_shares);
+                    total_rshares += to256(rshares.value);
+                    payout = u256_muldiv(u256(props.total_reward_fund.amount.value), u256(rshares.value), total_rshares);
+                }
+                if (new_total_rshares >= props.total_reward_shares) {
+                    fc_dlog(reward_math_logger(), "muldiv: ${a} ${b} ${c}",
+                            ("a", props.total_reward_fund.amount.value)("b", rshares.value)("c", std::string(new_total_rshares)));
+                }
 
                 modify(props, [&](dynamic_global_property_object &p) {
                     p.total_reward_fund.amount -= payout;
@@ -2968,11 +3186,17 @@ namespace graphene { namespace chain {
 
             // in case of multi-thread application, it's allow to validate transaction in read-thread
             if ((skip & validate_transaction_steps) != validate_transaction_steps) {
+                // recovering of keys doesn't depend on the state, so it's done before taking the lock
+                fc::optional<fc::flat_set<protocol::public_key_type>> signature_keys;
+                if (!(skip & (skip_transaction_signatures | skip_authority_check))) {
+                    signature_keys = trx.get_signature_keys(CHAIN_ID);
+                }
+
                 // this method can be used only for push_transaction(),
                 //  because such transactions only added to pending list,
                 //  and they will be rechecked on block generation
                 auto validate_action = [&]() {
-                    _validate_transaction(trx, skip);
+                    _validate_transaction(trx, skip, signature_keys ? &*signature_keys : nullptr);
                 };
 
                 if (!(skip & skip_database_locking)) {
@@ -3001,7 +3225,8 @@ namespace graphene { namespace chain {
             return skip;
         }
 
-        void database::_validate_transaction(const signed_transaction &trx, uint32_t skip) {
+        void database::_validate_transaction(const signed_transaction &trx, uint32_t skip,
+                const fc::flat_set<protocol::public_key_type> *signature_keys) {
             if (!(skip & skip_validate_operations)) {   /* issue #505 explains why this skip_flag is disabled */
                 trx.validate();
             }
@@ -3010,19 +3235,23 @@ namespace graphene { namespace chain {
                 const chain_id_type &chain_id = CHAIN_ID;
 
                 auto get_active = [&](const account_name_type& name) {
-                    return authority(get<account_authority_object, by_account>(name).active);
+                    return _my->get_authority(name, &database_impl::cached_account_authority::active);
                 };
 
                 auto get_master = [&](const account_name_type& name) {
-                    return authority(get<account_authority_object, by_account>(name).master);
+                    return _my->get_authority(name, &database_impl::cached_account_authority::master);
                 };
 
                 auto get_regular = [&](const account_name_type& name) {
-                    return authority(get<account_authority_object, by_account>(name).regular);
+                    return _my->get_authority(name, &database_impl::cached_account_authority::regular);
                 };
 
                 try {
-                    trx.verify_authority(chain_id, get_active, get_master, get_regular, CHAIN_MAX_SIG_CHECK_DEPTH);
+                    if (signature_keys) {
+                        protocol::verify_authority(trx.operations, *signature_keys, get_active, get_master, get_regular, CHAIN_MAX_SIG_CHECK_DEPTH);
+                    } else {
+                        trx.verify_authority(chain_id, get_active, get_master, get_regular, CHAIN_MAX_SIG_CHECK_DEPTH);
+                    }
                 }
                 catch (protocol::tx_missing_active_auth &e) {
                     if (get_shared_db_merkle().find(head_block_num() + 1) == get_shared_db_merkle().end()) {
@@ -3157,6 +3386,9 @@ namespace graphene { namespace chain {
                 const auto &hardfork_state = get_hardfork_property_object();
                 //block_id_type next_block_id = next_block.id();
 
+                // the cache can contain authorities from the undone pending state or from a popped fork
+                clear_state_caches();
+
                 _validate_block(next_block, skip);
 
                 const witness_object &signing_witness = validate_block_header(skip, next_block);
@@ -3319,20 +3551,23 @@ namespace graphene { namespace chain {
 
                 auto trx_size = fc::raw::pack_size(trx);
 
-                const witness_schedule_object &consensus = get_witness_schedule_object();
-
-                for (const auto& auth : required) {
-                    const auto& acnt = get_account(auth);
-                    update_account_bandwidth(acnt, trx_size);
-                    if(has_hardfork(CHAIN_HARDFORK_6)){
-                        for (const auto& op : trx.operations) {
-                            if (is_data_operation(op)) {
-                                 update_account_bandwidth(acnt, uint32_t(trx_size * consensus.median_props.data_operations_cost_additional_bandwidth / CHAIN_100_PERCENT));
-                            }
+                // the charge is the same for all required accounts, a decay after the first charge in the same
+                //   block time is a no-op, so the sum of charges is applied in one modify per account
+                share_type trx_bandwidth = trx_size * CHAIN_BANDWIDTH_PRECISION;
+                if(has_hardfork(CHAIN_HARDFORK_6)){
+                    const witness_schedule_object &consensus = get_witness_schedule_object();
+                    share_type data_bandwidth = uint32_t(trx_size * consensus.median_props.data_operations_cost_additional_bandwidth / CHAIN_100_PERCENT) * CHAIN_BANDWIDTH_PRECISION;
+                    for (const auto& op : trx.operations) {
+                        if (is_data_operation(op)) {
+                            trx_bandwidth += data_bandwidth;
                         }
                     }
                 }
 
+                for (const auto& auth : required) {
+                    charge_account_bandwidth(get_account(auth), trx_bandwidth);
+                }
+
                 //Insert transaction into unique transactions database.
                 if (!(skip & skip_transaction_dupe_check)) {
                     create<transaction_object>([&](transaction_object &transaction) {
@@ -3374,8 +3609,23 @@ namespace graphene { namespace chain {
                           next_block.timestamp, "", ("head_block_time", head_block_time())("next", next_block.timestamp)("blocknum", next_block.block_num()));
                 const witness_object &witness = get_witness(next_block.witness);
 
-                if (!(skip & skip_witness_signature))
-                    FC_ASSERT(next_block.validate_signee(witness.signing_key));
+                if (!(skip & skip_witness_signature)) {
+                    fc::optional<public_key_type> signee;
+                    {
+                        std::lock_guard<std::mutex> lock(_my->_block_signees_mutex);
+                        auto itr = _my->_block_signees.find(next_block.id());
+                        if (itr != _my->_block_signees.end()) {
+                            signee = itr->second;
+                            _my->_block_signees.erase(itr);
+                        }
+                    }
+
+                    if (signee.valid()) {
+                        FC_ASSERT(*signee == witness.signing_key);
+                    } else {
+                        FC_ASSERT(next_block.validate_signee(witness.signing_key));
+                    }
+                }
 
                 if (!(skip & skip_witness_schedule_check)) {
                     uint32_t slot_num = get_slot_at_time(next_block.timestamp);
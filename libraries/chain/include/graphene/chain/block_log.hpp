@@ -55,6 +55,11 @@ namespace graphene {
 
             optional <signed_block> read_block_by_num(uint32_t block_num) const;
 
+            /**
+             * Return the serialized block as it is stored in the log, or an empty vector if it does not exist.
+             */
+            std::vector<char> read_raw_block_by_num(uint32_t block_num) const;
+
             /**
              * Return offset of block in file, or block_log::npos if it does not exist.
              */
@@ -11,6 +11,7 @@
 
 #include <fc/log/logger.hpp>
 
+#include <exception>
 #include <map>
 
 namespace graphene { namespace chain {
@@ -40,6 +41,33 @@ namespace graphene { namespace chain {
 
             using chainbase::database::remove;
 
+            /**
+             * Runs the callback under the weak read lock of chainbase and adds the time spent
+             * waiting for the lock to the counter of the calling thread, see read_lock_wait().
+             */
+            template<typename Lambda>
+            auto with_weak_read_lock(Lambda &&callback) -> decltype(callback()) {
+                auto requested = fc::time_point::now();
+                return chainbase::database::with_weak_read_lock([&]() -> decltype(callback()) {
+                    add_read_lock_wait(fc::time_point::now() - requested);
+                    return callback();
+                });
+            }
+
+            template<typename Lambda>
+            auto with_weak_read_lock(Lambda &&callback) const -> decltype(callback()) {
+                auto requested = fc::time_point::now();
+                return chainbase::database::with_weak_read_lock([&]() -> decltype(callback()) {
+                    add_read_lock_wait(fc::time_point::now() - requested);
+                    return callback();
+                });
+            }
+
+            /// Time the calling thread has waited for weak read locks since reset_read_lock_wait()
+            static fc::microseconds read_lock_wait();
+
+            static void reset_read_lock_wait();
+
             bool is_producing() const {
                 return _is_producing;
             }
@@ -174,6 +202,12 @@ namespace graphene { namespace chain {
              */
             bool update_account_bandwidth(const account_object &a, uint32_t trx_size);
 
+            /**
+             * Same as update_account_bandwidth(), but charges already scaled bandwidth in a single modify,
+             *   it's equal to the sequence of calls with sizes summing up to trx_bandwidth / CHAIN_BANDWIDTH_PRECISION
+             */
+            bool charge_account_bandwidth(const account_object &a, share_type trx_bandwidth);
+
             void max_bandwidth_per_share() const;
 
             /**
@@ -192,12 +226,26 @@ namespace graphene { namespace chain {
 
             uint32_t validate_block(const signed_block &b, uint32_t skip = skip_nothing);
 
+            /**
+             * Recovers the witness signee of the block and caches it by block id,
+             *   so applying the block only has to compare keys under the write lock.
+             * It doesn't touch the state, so it can be called from several threads at once.
+             * @throw if the witness signature is malformed
+             */
+            public_key_type prevalidate_block_signee(const protocol::signed_block_header &b);
+
             bool push_block(const signed_block &b, uint32_t skip = skip_nothing);
 
             void enable_plugins_on_push_transaction(bool);
 
             void push_transaction(const signed_transaction &trx, uint32_t skip = skip_nothing);
 
+            /**
+             *  Pushes transactions one by one like push_transaction(), but takes the write lock once for all of them.
+             *  @return for each transaction the exception it was rejected with, or nullptr if it was pushed
+             */
+            std::vector<std::exception_ptr> push_transactions(const std::vector<signed_transaction> &trxs, uint32_t skip = skip_nothing);
+
             void _maybe_warn_multiple_production(uint32_t height) const;
 
             bool _push_block(const signed_block &b, uint32_t skip);
@@ -340,6 +388,12 @@ namespace graphene { namespace chain {
 
             void update_master_authority(const account_object &account, const authority &master_authority);
 
+            /**
+             * Authorities used to verify transactions are cached until the end of the block
+             *   or of the pending session. It should be called after any change of account_authority_object.
+             */
+            void invalidate_authority_cache(const account_name_type &account);
+
             asset get_balance(const account_object &a, asset_symbol_type symbol) const;
 
             asset get_balance(const string &aname, asset_symbol_type symbol) const {
@@ -447,6 +501,8 @@ namespace graphene { namespace chain {
         private:
             optional<chainbase::database::session> _pending_tx_session;
 
+            static void add_read_lock_wait(fc::microseconds);
+
             void apply_block(const signed_block &next_block, uint32_t skip = skip_nothing);
 
             void apply_transaction(const signed_transaction &trx, uint32_t skip = skip_nothing);
@@ -457,7 +513,10 @@ namespace graphene { namespace chain {
 
             void _apply_transaction(const signed_transaction &trx, uint32_t skip);
 
-            void _validate_transaction(const signed_transaction& trx, uint32_t skip);
+            void _validate_transaction(const signed_transaction& trx, uint32_t skip,
+                    const fc::flat_set<protocol::public_key_type> *signature_keys = nullptr);
+
+            void clear_state_caches();
 
             void apply_operation(const operation &op, bool is_virtual = false);
 
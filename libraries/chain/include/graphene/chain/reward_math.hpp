@@ -0,0 +1,58 @@
+#pragma once
+
+#include <graphene/protocol/types.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/uint128_t.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+
+namespace graphene {
+    namespace chain {
+
+        inline protocol::u256 to256(const fc::uint128_t &t) {
+            protocol::u256 v(t.hi);
+            v <<= 64;
+            v += t.lo;
+            return v;
+        }
+
+        /**
+         * Calculates a * b / c with u256 arithmetic, the result must fit share_type
+         */
+        inline uint64_t u256_muldiv(const protocol::u256 &a, const protocol::u256 &b, const protocol::u256 &c) {
+            protocol::u256 result = (a * b) / c;
+            FC_ASSERT(result <= protocol::u256(uint64_t(std::numeric_limits<int64_t>::max())));
+            return static_cast<uint64_t>(result);
+        }
+
+        /**
+         * Calculates a * b / c using native 128-bit integers. The product of two 64-bit values always fits
+         *   in 128 bits, so the result is exactly the same as with u256. Returns false if the native path
+         *   can't be used (no compiler support, zero divisor or the result doesn't fit share_type),
+         *   in such case the caller should use u256_muldiv().
+         */
+        inline bool fast_muldiv(int64_t a, int64_t b, const fc::uint128_t &c, uint64_t &result) {
+#ifdef __SIZEOF_INT128__
+            if (a < 0 || b < 0 || c == fc::uint128_t()) {
+                return false;
+            }
+
+            unsigned __int128 divisor = (static_cast<unsigned __int128>(c.hi) << 64) | c.lo;
+            unsigned __int128 quotient = static_cast<unsigned __int128>(a) * static_cast<uint64_t>(b) / divisor;
+            if (quotient > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+                return false;
+            }
+
+            result = static_cast<uint64_t>(quotient);
+            assert(protocol::u256(result) == protocol::u256(a) * protocol::u256(b) / to256(c));
+            return true;
+#else
+            return false;
+#endif
+        }
+
+    }
+} // graphene::chain
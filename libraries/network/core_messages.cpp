@@ -46,6 +46,14 @@ namespace graphene {
         const core_message_type_enum check_firewall_reply_message::type = core_message_type_enum::check_firewall_reply_message_type;
         const core_message_type_enum get_current_connections_request_message::type = core_message_type_enum::get_current_connections_request_message_type;
         const core_message_type_enum get_current_connections_reply_message::type = core_message_type_enum::get_current_connections_reply_message_type;
+        const core_message_type_enum compact_block_message::type = core_message_type_enum::compact_block_message_type;
+        const core_message_type_enum fetch_compact_block_transactions_message::type = core_message_type_enum::fetch_compact_block_transactions_message_type;
+        const core_message_type_enum compact_block_transactions_message::type = core_message_type_enum::compact_block_transactions_message_type;
+        const core_message_type_enum fetch_sync_block_range_message::type = core_message_type_enum::fetch_sync_block_range_message_type;
+        const core_message_type_enum compressed_message::type = core_message_type_enum::compressed_message_type;
+        const core_message_type_enum trx_reconciliation_request_message::type = core_message_type_enum::trx_reconciliation_request_message_type;
+        const core_message_type_enum trx_reconciliation_sketch_message::type = core_message_type_enum::trx_reconciliation_sketch_message_type;
+        const core_message_type_enum trx_reconciliation_result_message::type = core_message_type_enum::trx_reconciliation_result_message_type;
 
     }
 } // graphene::network
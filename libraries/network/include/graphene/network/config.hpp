@@ -57,6 +57,12 @@
 
 #define GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES        (1024 * 1024)
 
+/**
+ * When both transactions and address gossip are waiting to be sent to a peer,
+ * this many transactions are sent for each gossip message
+ */
+#define GRAPHENE_NET_TRANSACTIONS_PER_GOSSIP_MESSAGE         8
+
 /**
  * When we receive a message from the network, we advertise it to
  * our peers and save a copy in a cache were we will find it if
@@ -81,6 +87,64 @@
 
 #define GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING      200
 
+/**
+ * During sync each request is sized by the measured block rate of the peer so that it
+ * takes about GRAPHENE_NET_SYNC_REQUEST_TARGET_DURATION_SEC, but it's never smaller than
+ * this. Peers without measurements get requests of this size.
+ */
+#define GRAPHENE_NET_MIN_BLOCKS_PER_PEER_DURING_SYNCING      20
+#define GRAPHENE_NET_SYNC_REQUEST_TARGET_DURATION_SEC        5
+
+/**
+ * If the next block we need during sync was requested this long ago and still
+ * hasn't arrived, it's requested again from another idle peer which has it.
+ */
+#define GRAPHENE_NET_SYNC_STRAGGLER_TIMEOUT_SEC              5
+
+/**
+ * Messages of at least this size are encrypted, decrypted, hashed and unpacked on
+ * the decode threads (see message_oriented_connection::set_decode_thread_count()).
+ * Smaller messages are cheaper to handle in place than to hand off.
+ */
+#define GRAPHENE_NET_MIN_OFFLOADED_MESSAGE_SIZE              4096
+
+/**
+ * Number of ciphertext buffers kept for reuse by all connections, about
+ * the number of messages being sent at the same time.
+ */
+#define GRAPHENE_NET_MAX_POOLED_FRAME_BUFFERS                64
+
+/**
+ * Compression announced in the hello user data. The name covers the preset dictionary
+ * too, so it has to change whenever the dictionary does.
+ * Only messages of at least GRAPHENE_NET_MIN_COMPRESSED_MESSAGE_SIZE bytes are compressed.
+ */
+#define GRAPHENE_NET_COMPRESSION_ALGORITHM                   "deflate-dict1"
+#define GRAPHENE_NET_MIN_COMPRESSED_MESSAGE_SIZE             512
+
+/**
+ * Transaction inventory is flooded to peers which don't support reconciliation and to
+ * GRAPHENE_NET_TRX_FLOOD_PEERS of the outbound peers which do. The rest of the peers learn
+ * about transactions by reconciling sets of short ids every GRAPHENE_NET_TRX_RECONCILIATION_INTERVAL_MS,
+ * a set which grows over GRAPHENE_NET_MAX_TRX_RECONCILIATION_SET_SIZE is flooded instead.
+ */
+#define GRAPHENE_NET_TRX_FLOOD_PEERS                         4
+#define GRAPHENE_NET_TRX_RECONCILIATION_INTERVAL_MS          2000
+#define GRAPHENE_NET_MAX_TRX_RECONCILIATION_SET_SIZE         4000
+
+/**
+ * Peers to connect to are ordered by how fast they relay blocks, each protocol violation
+ * counts as GRAPHENE_NET_PEER_MISBEHAVIOR_PENALTY_MS of relay lag.  Every
+ * GRAPHENE_NET_PEER_EXPLORATION_INTERVAL-th connection goes to a peer we haven't measured yet.
+ */
+#define GRAPHENE_NET_PEER_MISBEHAVIOR_PENALTY_MS             2000
+#define GRAPHENE_NET_PEER_EXPLORATION_INTERVAL               4
+
+/**
+ * Version of the binary peer database file, records of another version are dropped
+ */
+#define GRAPHENE_NET_PEER_DATABASE_VERSION                   1
+
 /**
  * During normal operation, how many items will be fetched from each
  * peer at a time.  This will only come into play when the network
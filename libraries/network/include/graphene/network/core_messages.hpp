@@ -89,6 +89,14 @@ namespace graphene {
             check_firewall_reply_message_type = 5015,
             get_current_connections_request_message_type = 5016,
             get_current_connections_reply_message_type = 5017,
+            compact_block_message_type = 5018,
+            fetch_compact_block_transactions_message_type = 5019,
+            compact_block_transactions_message_type = 5020,
+            fetch_sync_block_range_message_type = 5021,
+            compressed_message_type = 5022,
+            trx_reconciliation_request_message_type = 5023,
+            trx_reconciliation_sketch_message_type = 5024,
+            trx_reconciliation_result_message_type = 5025,
             core_message_type_last = 5099
         };
 
@@ -419,6 +427,164 @@ namespace graphene {
             std::vector<current_connection_data> current_connections;
         };
 
+        /**
+         *  Block without transaction bodies, sent instead of block_message to peers which requested
+         *  items of compact_block_message_type. The receiver takes the transactions from its
+         *  message cache and fetches only the missing ones.
+         */
+        struct compact_block_message {
+            static const core_message_type_enum type;
+
+            item_hash_t block_message_hash; // hash of the full block_message, which is the requested item
+            block_id_type block_id;
+            graphene::protocol::signed_block_header header;
+            std::vector<transaction_id_type> transaction_ids;
+
+            compact_block_message() {
+            }
+
+            compact_block_message(const item_hash_t &block_message_hash, const block_message &full_block)
+                    : block_message_hash(block_message_hash),
+                      block_id(full_block.block_id),
+                      header(full_block.block) {
+                transaction_ids.reserve(full_block.block.transactions.size());
+                for (const auto &trx : full_block.block.transactions) {
+                    transaction_ids.push_back(trx.id());
+                }
+            }
+        };
+
+        struct fetch_compact_block_transactions_message {
+            static const core_message_type_enum type;
+
+            item_hash_t block_message_hash;
+            std::vector<uint32_t> transaction_indexes; // positions of missing transactions in the block
+
+            fetch_compact_block_transactions_message() {
+            }
+
+            fetch_compact_block_transactions_message(const item_hash_t &block_message_hash,
+                    const std::vector<uint32_t> &transaction_indexes)
+                    : block_message_hash(block_message_hash),
+                      transaction_indexes(transaction_indexes) {
+            }
+        };
+
+        struct compact_block_transactions_message {
+            static const core_message_type_enum type;
+
+            item_hash_t block_message_hash;
+            std::vector<signed_transaction> transactions; // in the order of requested transaction_indexes
+
+            compact_block_transactions_message() {
+            }
+
+            compact_block_transactions_message(const item_hash_t &block_message_hash)
+                    : block_message_hash(block_message_hash) {
+            }
+        };
+
+        /**
+         *  Requests count consecutive blocks of the peer's chain starting with first_block,
+         *  the peer replies with block_message for each of them
+         */
+        struct fetch_sync_block_range_message {
+            static const core_message_type_enum type;
+
+            item_hash_t first_block;
+            uint32_t count;
+
+            fetch_sync_block_range_message() {
+            }
+
+            fetch_sync_block_range_message(const item_hash_t &first_block, uint32_t count)
+                    : first_block(first_block),
+                      count(count) {
+            }
+        };
+
+        /**
+         *  Wraps another message with its body deflated, sent only to peers which announced
+         *  GRAPHENE_NET_COMPRESSION_ALGORITHM in their hello user data
+         */
+        struct compressed_message {
+            static const core_message_type_enum type;
+
+            uint32_t msg_type;       // type of the original message
+            uint32_t size;           // size of the original message body
+            std::vector<char> data;  // deflated original message body
+
+            compressed_message() {
+            }
+
+            compressed_message(uint32_t msg_type, uint32_t size, std::vector<char> &&data)
+                    : msg_type(msg_type),
+                      size(size),
+                      data(std::move(data)) {
+            }
+        };
+
+        /**
+         *  Starts reconciliation of the transactions each side of the connection has but hasn't
+         *  advertised to the other yet, sent periodically by the side which opened the connection
+         */
+        struct trx_reconciliation_request_message {
+            static const core_message_type_enum type;
+
+            uint32_t set_size;     // number of transactions in the requester's set
+            uint16_t q_per_mille;  // expected difference per transaction of the smaller set, learned from the last round
+
+            trx_reconciliation_request_message() {
+            }
+
+            trx_reconciliation_request_message(uint32_t set_size, uint16_t q_per_mille)
+                    : set_size(set_size),
+                      q_per_mille(q_per_mille) {
+            }
+        };
+
+        /** Cell of an invertible bloom lookup table of short transaction ids */
+        struct trx_reconciliation_sketch_cell {
+            int32_t count = 0;
+            uint32_t id_sum = 0;     // xor of the short ids in the cell
+            uint32_t check_sum = 0;  // xor of the hashes of the short ids in the cell
+        };
+
+        /** Reply to trx_reconciliation_request_message, the sketch of the responder's set */
+        struct trx_reconciliation_sketch_message {
+            static const core_message_type_enum type;
+
+            uint32_t set_size;
+            std::vector<trx_reconciliation_sketch_cell> sketch;
+
+            trx_reconciliation_sketch_message() {
+            }
+
+            trx_reconciliation_sketch_message(uint32_t set_size, std::vector<trx_reconciliation_sketch_cell> &&sketch)
+                    : set_size(set_size),
+                      sketch(std::move(sketch)) {
+            }
+        };
+
+        /**
+         *  Ends a reconciliation round. On success the responder advertises the transactions
+         *  with missing_ids, otherwise the sets differ too much and both sides advertise all of them.
+         */
+        struct trx_reconciliation_result_message {
+            static const core_message_type_enum type;
+
+            bool success;
+            std::vector<uint32_t> missing_ids;  // short ids the requester doesn't have
+
+            trx_reconciliation_result_message() {
+            }
+
+            trx_reconciliation_result_message(bool success, std::vector<uint32_t> &&missing_ids)
+                    : success(success),
+                      missing_ids(std::move(missing_ids)) {
+            }
+        };
+
 
     }
 } // graphene::network
@@ -444,6 +610,14 @@ FC_REFLECT_ENUM(graphene::network::core_message_type_enum,
                 (check_firewall_reply_message_type)
                 (get_current_connections_request_message_type)
                 (get_current_connections_reply_message_type)
+                (compact_block_message_type)
+                (fetch_compact_block_transactions_message_type)
+                (compact_block_transactions_message_type)
+                (fetch_sync_block_range_message_type)
+                (compressed_message_type)
+                (trx_reconciliation_request_message_type)
+                (trx_reconciliation_sketch_message_type)
+                (trx_reconciliation_result_message_type)
                 (core_message_type_last))
 
 FC_REFLECT((graphene::network::trx_message), (trx))
@@ -527,6 +701,28 @@ FC_REFLECT((graphene::network::get_current_connections_reply_message), (upload_r
         (upload_rate_one_hour)
         (download_rate_one_hour)
         (current_connections))
+FC_REFLECT((graphene::network::compact_block_message), (block_message_hash)
+        (block_id)
+        (header)
+        (transaction_ids))
+FC_REFLECT((graphene::network::fetch_compact_block_transactions_message), (block_message_hash)
+        (transaction_indexes))
+FC_REFLECT((graphene::network::compact_block_transactions_message), (block_message_hash)
+        (transactions))
+FC_REFLECT((graphene::network::fetch_sync_block_range_message), (first_block)
+        (count))
+FC_REFLECT((graphene::network::compressed_message), (msg_type)
+        (size)
+        (data))
+FC_REFLECT((graphene::network::trx_reconciliation_request_message), (set_size)
+        (q_per_mille))
+FC_REFLECT((graphene::network::trx_reconciliation_sketch_cell), (count)
+        (id_sum)
+        (check_sum))
+FC_REFLECT((graphene::network::trx_reconciliation_sketch_message), (set_size)
+        (sketch))
+FC_REFLECT((graphene::network::trx_reconciliation_result_message), (success)
+        (missing_ids))
 
 #include <unordered_map>
 #include <fc/crypto/city.hpp>
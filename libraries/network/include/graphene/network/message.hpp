@@ -30,6 +30,8 @@
 #include <fc/crypto/ripemd160.hpp>
 #include <fc/reflect/variant.hpp>
 
+#include <memory>
+
 namespace graphene {
     namespace network {
 
@@ -64,6 +66,18 @@ namespace graphene {
                     : message_header(m), data(m.data) {
             }
 
+            message &operator=(message &&m) {
+                message_header::operator=(m);
+                data = std::move(m.data);
+                return *this;
+            }
+
+            message &operator=(const message &m) {
+                message_header::operator=(m);
+                data = m.data;
+                return *this;
+            }
+
             /**
              *  Assumes that T::type specifies the message type
              */
@@ -105,6 +119,11 @@ namespace graphene {
             }
         };
 
+        /**
+         *  A message shared by the message cache and the send queues of all peers it goes to,
+         *  so a large block is kept once however many peers fetch it. It must not change once shared.
+         */
+        typedef std::shared_ptr<const message> shared_message_ptr;
 
     }
 } // graphene::network
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <graphene/network/message.hpp>
+
+#include <fc/thread/future.hpp>
+
+namespace graphene {
+    namespace network {
+
+        /**
+         *  Deflates the body of message_to_compress with the preset dictionary of
+         *  GRAPHENE_NET_COMPRESSION_ALGORITHM and wraps it into a compressed_message.
+         *  @return false if the message is too small or compressing it doesn't make it smaller
+         */
+        bool compress_message(const message &message_to_compress, message &result);
+
+        /**
+         *  Compresses the message on a decode thread when it's large, in place otherwise.
+         *  The task owns the message, so the fiber waiting for it can be canceled at any time.
+         *  @return future of the compressed message or of nullptr if it isn't worth compressing
+         */
+        fc::future<shared_message_ptr> compress_message_async(shared_message_ptr message_to_compress);
+
+        /** Restores the message wrapped into a compressed_message, throws if it's malformed */
+        message decompress_message(const message &compressed);
+
+    }
+} // graphene::network
@@ -24,7 +24,10 @@
 #pragma once
 
 #include <fc/network/tcp_socket.hpp>
+#include <fc/thread/thread.hpp>
 #include <graphene/network/message.hpp>
+#include <graphene/network/config.hpp>
+#include <graphene/network/offloaded_task.hpp>
 
 namespace graphene {
     namespace network {
@@ -74,11 +77,38 @@ namespace graphene {
 
             fc::sha512 get_shared_secret() const;
 
+            /**
+             *  Starts count threads which decrypt and decode large messages of all connections,
+             *  with zero threads everything is done on the thread owning the connection.
+             *  It should not be called while connections are open.
+             */
+            static void set_decode_thread_count(uint32_t count);
+
+            /** @return next decode thread in round robin order or nullptr if there are none */
+            static fc::thread *get_decode_thread();
+
         private:
             std::unique_ptr<detail::message_oriented_connection_impl> my;
         };
 
         typedef std::shared_ptr<message_oriented_connection> message_oriented_connection_ptr;
 
+        /**
+         *  Runs decoding of a message of message_size bytes on one of the decode threads and waits for
+         *  the result, so the calling fc::thread keeps serving other tasks. Small messages are decoded in place.
+         *  f may refer to the caller's buffers, see run_offloaded_task() for what happens on cancellation.
+         */
+        template<typename Functor>
+        auto run_decode_task(size_t message_size, Functor &&f) -> decltype(f()) {
+            fc::thread *decode_thread = nullptr;
+            if (message_size >= GRAPHENE_NET_MIN_OFFLOADED_MESSAGE_SIZE) {
+                decode_thread = message_oriented_connection::get_decode_thread();
+            }
+            if (decode_thread == nullptr) {
+                return f();
+            }
+            return run_offloaded_task(*decode_thread, f, "p2p decode");
+        }
+
     }
 } // graphene::network
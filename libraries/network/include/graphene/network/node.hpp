@@ -30,6 +30,7 @@
 #include <graphene/protocol/types.hpp>
 
 #include <list>
+#include <random>
 
 namespace graphene {
     namespace network {
@@ -79,6 +80,25 @@ namespace graphene {
             virtual bool handle_block(const graphene::network::block_message &blk_msg, bool sync_mode,
                     std::vector<fc::uint160_t> &contained_transaction_message_ids) = 0;
 
+            /**
+             *  @brief Called with headers of sync blocks just received from the network, before
+             *         the blocks are passed one by one to handle_block().  Lets the client do
+             *         stateless checks (like recovering of witness signatures) for the whole batch.
+             *
+             *  Failed checks are not reported here, such blocks are rejected by handle_block().
+             */
+            virtual void prevalidate_sync_blocks(const std::vector<graphene::protocol::signed_block_header> &headers) = 0;
+
+            /**
+             *  @brief Called in header-first relay mode with a block received during normal operation,
+             *         before it is passed to handle_block().  Checks what can be checked without applying
+             *         the block: that it links to the head block, that its witness is scheduled for its
+             *         slot and that the witness signed it.
+             *
+             *  @throws exception if the block can't be relayed before it's applied
+             */
+            virtual void prevalidate_block_for_relay(const graphene::network::block_message &blk_msg) = 0;
+
             /**
              *  @brief Called when a new transaction comes in from the network
              *
@@ -113,6 +133,12 @@ namespace graphene {
              */
             virtual message get_item(const item_id &id) = 0;
 
+            /**
+             *  Fetch up to count consecutive blocks of our chain starting with first_block,
+             *  the result is empty if first_block isn't on our chain
+             */
+            virtual std::vector<message> get_block_range(const item_hash_t &first_block, uint32_t count) = 0;
+
             /**
              * Returns a synopsis of the blockchain used for syncing.
              * This consists of a list of selected item hashes from our current preferred
@@ -331,6 +357,13 @@ namespace graphene {
 
             void add_node_delegate(node_delegate *node_delegate_to_add);
 
+            /**
+             *  Makes delivery to each delegate behave like a link with the given one-way latency,
+             *  bandwidth in bytes per second (0 for unlimited) and probability of losing a message.
+             *  Messages are delivered instantly and reliably by default.
+             */
+            void set_link_properties(fc::microseconds latency, uint32_t bandwidth_bytes_per_second, double loss_probability);
+
             virtual uint32_t get_connection_count() const override {
                 return 8;
             }
@@ -341,6 +374,10 @@ namespace graphene {
             void message_sender(node_info *destination_node);
 
             std::list<node_info *> network_nodes;
+            fc::microseconds link_latency;
+            uint32_t link_bandwidth = 0;
+            double link_loss_probability = 0;
+            std::minstd_rand link_random_engine;
         };
 
 
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <fc/thread/thread.hpp>
+
+#include <future>
+#include <memory>
+
+namespace graphene {
+    namespace network {
+
+        /**
+         *  Runs f on thread and waits for its result, the calling fc::thread keeps serving its other tasks meanwhile.
+         *  f works on the caller's stack and buffers, so they can't be released before f has finished:
+         *  when the waiting task is canceled, the calling thread is blocked until f returns,
+         *  and only then the cancellation is rethrown.
+         */
+        template<typename Functor>
+        auto run_offloaded_task(fc::thread &thread, Functor &&f, const char *description) -> decltype(f()) {
+            auto finished = std::make_shared<std::promise<void>>();
+            std::future<void> finished_future = finished->get_future();
+
+            // a task dropped without running breaks the promise, which ends the wait as well
+            fc::future<decltype(f())> result = thread.async([&f, finished]() {
+                struct notify_finished {
+                    std::shared_ptr<std::promise<void>> finished;
+
+                    ~notify_finished() {
+                        finished->set_value();
+                    }
+                } notify{finished};
+                return f();
+            }, description);
+            finished.reset();
+
+            try {
+                return result.wait();
+            } catch (...) {
+                // a canceled fc task can't wait on fc futures anymore
+                result = fc::future<decltype(f())>();
+                finished_future.wait();
+                throw;
+            }
+        }
+
+    }
+} // graphene::network
@@ -40,7 +40,10 @@
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 
+#include <array>
+#include <list>
 #include <queue>
+#include <unordered_map>
 #include <boost/container/deque.hpp>
 #include <fc/thread/future.hpp>
 
@@ -69,7 +72,13 @@ namespace graphene {
 
             virtual void on_connection_closed(peer_connection *originating_peer) = 0;
 
-            virtual message get_message_for_item(const item_id &item) = 0;
+            virtual shared_message_ptr get_message_for_item(const item_id &item) = 0;
+
+            /**
+             *  Returns the message compressed for the peers which support it, nullptr if it isn't worth it.
+             *  A cached message is compressed once, all peers it goes to share the result.
+             */
+            virtual fc::future<shared_message_ptr> get_compressed_message(const shared_message_ptr &message_to_compress) = 0;
         };
 
         class peer_connection;
@@ -91,6 +100,18 @@ namespace graphene {
                 connection_accepted, // we have sent them a connection_accepted
                 connection_rejected // we have sent them a connection_rejected
             };
+            /**
+             * Queued messages are sent by class: blocks and everything keeping the protocol
+             * going first, then transactions, then address gossip, which is dropped first
+             * when the peer can't keep up
+             */
+            enum class send_queue_class {
+                blocks,
+                transactions,
+                gossip
+            };
+            static const unsigned send_queue_class_count = 3;
+
             enum class connection_negotiation_status {
                 disconnected,
                 connecting,
@@ -116,13 +137,15 @@ namespace graphene {
                 fc::time_point enqueue_time;
                 fc::time_point transmission_start_time;
                 fc::time_point transmission_finish_time;
+                send_queue_class queue_class;
 
-                queued_message(fc::time_point enqueue_time = fc::time_point::now())
+                queued_message(send_queue_class queue_class, fc::time_point enqueue_time = fc::time_point::now())
                         :
-                        enqueue_time(enqueue_time) {
+                        enqueue_time(enqueue_time),
+                        queue_class(queue_class) {
                 }
 
-                virtual message get_message(peer_connection_delegate *node) = 0;
+                virtual shared_message_ptr get_message(peer_connection_delegate *node) = 0;
 
                 /** returns roughly the number of bytes of memory the message is consuming while
                  * it is sitting on the queue
@@ -133,20 +156,21 @@ namespace graphene {
                 }
             };
 
-            /* when you queue up a 'real_queued_message', a full copy of the message is
-             * stored on the heap until it is sent
+            /* when you queue up a 'real_queued_message', the message is kept on the heap
+             * until it is sent, shared with the other queues and the cache holding it
              */
             struct real_queued_message : queued_message {
-                message message_to_send;
+                shared_message_ptr message_to_send;
                 size_t message_send_time_field_offset;
 
-                real_queued_message(message message_to_send,
+                real_queued_message(shared_message_ptr message_to_send,
                         size_t message_send_time_field_offset = (size_t)-1) :
+                        queued_message(get_send_queue_class(message_to_send->msg_type)),
                         message_to_send(std::move(message_to_send)),
                         message_send_time_field_offset(message_send_time_field_offset) {
                 }
 
-                message get_message(peer_connection_delegate *node) override;
+                shared_message_ptr get_message(peer_connection_delegate *node) override;
 
                 size_t get_size_in_queue() override;
             };
@@ -159,17 +183,30 @@ namespace graphene {
                 item_id item_to_send;
 
                 virtual_queued_message(item_id item_to_send) :
+                        queued_message(get_send_queue_class(item_to_send.item_type)),
                         item_to_send(std::move(item_to_send)) {
                 }
 
-                message get_message(peer_connection_delegate *node) override;
+                shared_message_ptr get_message(peer_connection_delegate *node) override;
 
                 size_t get_size_in_queue() override;
             };
 
 
+            struct send_queue {
+                std::list<std::unique_ptr<queued_message>> messages;
+                size_t size_in_bytes = 0;
+                uint64_t messages_sent = 0;
+                uint64_t messages_dropped = 0;
+                fc::microseconds average_latency; /// moving average of the time messages wait in the queue
+            };
+
+            static send_queue_class get_send_queue_class(uint32_t msg_type);
+
             size_t _total_queued_messages_size;
-            std::queue<std::unique_ptr<queued_message>, std::list<std::unique_ptr<queued_message>>> _queued_messages;
+            std::array<send_queue, send_queue_class_count> _send_queues;
+            uint32_t _transactions_sent_in_a_row;
+            const queued_message *_message_being_sent;
             fc::future<void> _send_queued_messages_done;
         public:
             fc::time_point connection_initiation_time;
@@ -237,6 +274,11 @@ namespace graphene {
             fc::time_point last_sync_item_received_time; /// the time we received the last sync item or the time we sent the last batch of sync item requests to this peer
             std::set<item_hash_t> sync_items_requested_from_peer; /// ids of blocks we've requested from this peer during sync.  fetch from another peer if this peer disconnects
             item_hash_t last_block_delegate_has_seen; /// the hash of the last block  this peer has told us about that the peer knows
+            bool supports_block_ranges; /// peer serves fetch_sync_block_range_message
+            uint32_t sync_block_rate; /// blocks per second this peer delivered our sync requests with, 0 if unknown
+            fc::time_point sync_request_sent_time; /// when the current batch of sync items was requested
+            uint32_t sync_request_size; /// number of sync items in the current batch
+            bool sync_request_is_range; /// the current batch was requested with fetch_sync_block_range_message
             fc::time_point_sec last_block_time_delegate_has_seen;
             bool inhibit_fetching_sync_blocks;
             /// @}
@@ -265,6 +307,28 @@ namespace graphene {
             timestamped_items_set_type inventory_advertised_to_peer;
 
             item_to_time_map_type items_requested_from_peer;  /// items we've requested from this peer during normal operation.  fetch from another peer if this peer disconnects
+
+            bool supports_compact_blocks; /// peer sends compact_block_message when asked for compact_block_message_type items
+
+            bool supports_compression; /// peer inflates compressed_message, so we send large messages to it compressed
+
+            bool relays_header_first; /// peer relays blocks after checking their header, before applying them
+
+            bool supports_trx_reconciliation; /// peer learns about our transactions by reconciliation instead of inventory
+            uint64_t trx_reconciliation_salt; /// salt of short transaction ids on this connection
+            std::unordered_map<uint32_t, item_hash_t> trx_reconciliation_set; /// transactions not yet advertised to the peer, by short id
+            std::unordered_map<uint32_t, item_hash_t> trx_reconciliation_set_sent; /// the set we sent a sketch of, until the peer sends the result
+            bool trx_reconciliation_requested; /// we requested a sketch and wait for it
+            fc::time_point last_trx_reconciliation_time;
+            uint16_t trx_reconciliation_q_per_mille; /// difference of the last round per transaction of the smaller set
+            uint32_t trx_reconciliations_succeeded;
+            uint32_t trx_reconciliations_failed;
+
+            struct partial_compact_block {
+                compact_block_message compact_block;
+                std::vector<fc::optional<signed_transaction>> transactions;
+            };
+            std::map<item_hash_t, partial_compact_block> compact_blocks_being_reconstructed; /// compact blocks from this peer waiting for their missing transactions, by block message hash
             /// @}
 
             // if they're flooding us with transactions, we set this to avoid fetching for a few seconds to let the
@@ -304,6 +368,9 @@ namespace graphene {
 
             void send_message(const message &message_to_send, size_t message_send_time_field_offset = (size_t)-1);
 
+            /** Queues a message without copying it, for messages sent to many peers */
+            void send_message(shared_message_ptr message_to_send);
+
             void send_item(const item_id &item_to_send);
 
             void close_connection();
@@ -342,7 +409,14 @@ namespace graphene {
 
             fc::optional<fc::ip::endpoint> get_endpoint_for_connecting() const;
 
+            /** @return depth, latency and drop counters of each send queue, for get_connected_peers() */
+            fc::variants get_send_queue_status() const;
+
         private:
+            send_queue *get_next_send_queue();
+
+            void drop_gossip_messages();
+
             void send_queued_messages_task();
 
             void accept_connection_task();
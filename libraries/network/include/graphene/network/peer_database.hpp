@@ -33,6 +33,11 @@
 #include <fc/exception/exception.hpp>
 #include <fc/io/raw.hpp>
 
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <vector>
+
 namespace graphene {
     namespace network {
 
@@ -53,9 +58,23 @@ namespace graphene {
             uint32_t number_of_failed_connection_attempts;
             fc::optional<fc::exception> last_error;
 
+            /// quality of the peer measured while we were connected, 0 if never measured
+            /// @{
+            uint32_t round_trip_delay_ms; /// moving average
+            uint32_t sync_block_rate; /// moving average of blocks per second delivered to our sync requests
+            uint32_t block_relay_lag_ms; /// moving average of how long after the first peer this one announced new blocks
+            uint32_t number_of_blocks_announced_first;
+            uint32_t number_of_misbehaviors; /// times we disconnected the peer for breaking the protocol
+            /// @}
+
             potential_peer_record() :
                     number_of_successful_connection_attempts(0),
-                    number_of_failed_connection_attempts(0) {
+                    number_of_failed_connection_attempts(0),
+                    round_trip_delay_ms(0),
+                    sync_block_rate(0),
+                    block_relay_lag_ms(0),
+                    number_of_blocks_announced_first(0),
+                    number_of_misbehaviors(0) {
             }
 
             potential_peer_record(fc::ip::endpoint endpoint,
@@ -66,7 +85,33 @@ namespace graphene {
                     last_seen_time(last_seen_time),
                     last_connection_disposition(last_connection_disposition),
                     number_of_successful_connection_attempts(0),
-                    number_of_failed_connection_attempts(0) {
+                    number_of_failed_connection_attempts(0),
+                    round_trip_delay_ms(0),
+                    sync_block_rate(0),
+                    block_relay_lag_ms(0),
+                    number_of_blocks_announced_first(0),
+                    number_of_misbehaviors(0) {
+            }
+
+            bool has_relayed_blocks() const {
+                return block_relay_lag_ms != 0 || number_of_blocks_announced_first != 0;
+            }
+
+            void record_round_trip_delay(fc::microseconds delay) {
+                round_trip_delay_ms = update_average(round_trip_delay_ms, (uint32_t)std::max<int64_t>(delay.count() / 1000, 1));
+            }
+
+            void record_block_announcement(fc::microseconds lag) {
+                if (lag.count() <= 0) {
+                    ++number_of_blocks_announced_first;
+                }
+                // 1 ms marks the peer as measured even if it always announces first
+                block_relay_lag_ms = update_average(block_relay_lag_ms, (uint32_t)std::max<int64_t>(lag.count() / 1000, 1));
+            }
+
+        private:
+            static uint32_t update_average(uint32_t average, uint32_t sample) {
+                return average == 0 ? sample : (uint32_t)((uint64_t(average) * 7 + sample) / 8);
             }
         };
 
@@ -121,6 +166,23 @@ namespace graphene {
 
             fc::optional<potential_peer_record> lookup_entry_for_endpoint(const fc::ip::endpoint &endpointToLookup);
 
+            /**
+             *  Orders the peers worth connecting to now, best first. Most places go to the peers relaying
+             *  blocks the fastest, preferring subnets we aren't connected to yet. Every
+             *  GRAPHENE_NET_PEER_EXPLORATION_INTERVAL-th place goes to a random peer not measured yet,
+             *  so new peers get the chance to show how fast they are.
+             *  @param is_eligible filters out the peers which can't be connected to right now
+             *  @param connected_subnets subnets (see get_subnet()) of the peers we are connected to
+             */
+            std::vector<fc::ip::endpoint> get_connection_candidates(
+                    const std::function<bool(const potential_peer_record &)> &is_eligible,
+                    std::set<uint32_t> connected_subnets) const;
+
+            /// the /16 an IPv4 address belongs to, peers in one are likely run by the same operator
+            static uint32_t get_subnet(const fc::ip::address &address) {
+                return uint32_t(address) >> 16;
+            }
+
             typedef detail::peer_database_iterator iterator;
 
             iterator begin() const;
@@ -137,4 +199,5 @@ namespace graphene {
 } // end namespace graphene::network
 
 FC_REFLECT_ENUM(graphene::network::potential_peer_last_connection_disposition, (never_attempted_to_connect)(last_connection_failed)(last_connection_rejected)(last_connection_handshaking_failed)(last_connection_succeeded))
-FC_REFLECT((graphene::network::potential_peer_record), (endpoint)(last_seen_time)(last_connection_disposition)(last_connection_attempt_time)(number_of_successful_connection_attempts)(number_of_failed_connection_attempts)(last_error))
+FC_REFLECT((graphene::network::potential_peer_record), (endpoint)(last_seen_time)(last_connection_disposition)(last_connection_attempt_time)(number_of_successful_connection_attempts)(number_of_failed_connection_attempts)(last_error)
+        (round_trip_delay_ms)(sync_block_rate)(block_relay_lag_ms)(number_of_blocks_announced_first)(number_of_misbehaviors))
@@ -24,6 +24,7 @@
 #pragma once
 
 #include <fc/network/tcp_socket.hpp>
+#include <fc/thread/thread.hpp>
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/elliptic.hpp>
 
@@ -54,12 +55,27 @@ namespace graphene {
 
             virtual size_t readsome(const std::shared_ptr<char> &buf, size_t len, size_t offset);
 
+            /**
+             *  Reads exactly len bytes (a multiple of 16) and decrypts them on decode_thread,
+             *  the calling thread keeps running its other tasks while the data is decrypted
+             */
+            void read_and_decode_on(fc::thread &decode_thread, char *buffer, size_t len);
+
             virtual bool eof() const;
 
             virtual size_t writesome(const char *buffer, size_t len);
 
             virtual size_t writesome(const std::shared_ptr<const char> &buf, size_t len, size_t offset);
 
+            /**
+             *  Encrypts header (at most 16 bytes) followed by body, zero padded to a multiple of 16 bytes,
+             *  and writes it with a single socket write. The body is encrypted from where it is,
+             *  on encode_thread if it's given. It doesn't return before the encoding has finished,
+             *  even when the calling task is canceled.
+             */
+            void write_frame(const char *header, size_t header_len, const char *body, size_t body_len,
+                    fc::thread *encode_thread = nullptr);
+
             virtual void flush();
 
             virtual void close();
@@ -84,8 +100,6 @@ namespace graphene {
             fc::tcp_socket _sock;
             fc::aes_encoder _send_aes;
             fc::aes_decoder _recv_aes;
-            std::shared_ptr<char> _read_buffer;
-            std::shared_ptr<char> _write_buffer;
 #ifndef NDEBUG
             bool _read_buffer_in_use;
             bool _write_buffer_in_use;
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <graphene/network/core_messages.hpp>
+
+namespace graphene {
+    namespace network {
+
+        /**
+         *  Combines the salts both ends of a connection announced in their hello, so each side
+         *  computes the same short transaction ids
+         */
+        uint64_t get_trx_reconciliation_salt(uint64_t our_salt, uint64_t their_salt);
+
+        /** 32 bit id of a transaction message, salted per connection to make collisions hard to provoke */
+        uint32_t get_short_trx_id(uint64_t salt, const item_hash_t &trx_message_id);
+
+        /**
+         *  Invertible bloom lookup table of short transaction ids. Subtracting the sketch of
+         *  another set leaves their symmetric difference, which can be listed as long as it
+         *  isn't much larger than the capacity the sketches were made for.
+         */
+        class trx_reconciliation_sketch {
+        public:
+            /** Makes an empty sketch able to decode a difference of about capacity ids */
+            explicit trx_reconciliation_sketch(uint32_t capacity);
+
+            /** Takes the cells received from a peer, throws if there can't be such a sketch */
+            explicit trx_reconciliation_sketch(std::vector<trx_reconciliation_sketch_cell> &&cells);
+
+            void add(uint32_t short_id);
+
+            /** Leaves in this sketch the difference of this and other sets, both have to be of the same size */
+            void subtract(const trx_reconciliation_sketch &other);
+
+            /**
+             *  Lists the difference left by subtract()
+             *  @return false if the difference is too large to decode
+             */
+            bool decode(std::vector<uint32_t> &only_ours, std::vector<uint32_t> &only_theirs) const;
+
+            size_t size() const {
+                return cells.size();
+            }
+
+            std::vector<trx_reconciliation_sketch_cell> release_cells() {
+                return std::move(cells);
+            }
+
+            static size_t get_cell_count(uint32_t capacity);
+
+        private:
+            void toggle(uint32_t short_id, int32_t count);
+
+            std::vector<trx_reconciliation_sketch_cell> cells;
+        };
+
+    }
+} // graphene::network
@@ -0,0 +1,129 @@
+#include <graphene/network/message_compression.hpp>
+#include <graphene/network/message_oriented_connection.hpp>
+#include <graphene/network/core_messages.hpp>
+#include <graphene/network/config.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <zlib.h>
+
+namespace graphene {
+    namespace network {
+
+        namespace detail {
+
+            /**
+             *  Preset dictionary for deflate, it has to be the same on both ends of a connection,
+             *  so any change requires a new GRAPHENE_NET_COMPRESSION_ALGORITHM name.
+             *  Transactions are packed binary, but custom operations and memos carry text,
+             *  which is what is worth priming: the most frequent fragments go last,
+             *  where they are the cheapest to refer to.
+             */
+            static const char compression_dictionary[] =
+                    "https://http://.jpg.png.gif.mp4youtube.comtelegramviz.world"
+                    "\"title\":\"\"body\":\"\"text\":\"\"description\":\"\"image\":\"\"url\":\"\"link\":\""
+                    "\"app\":\"\"version\":\"\"format\":\"markdown\"\"tags\":[\"\"lang\":\"\"timestamp\":"
+                    "\"account\":\"\"author\":\"\"permlink\":\"\"parent_author\":\"\"parent_permlink\":\""
+                    "[\"reblog\",{\"account\":\"[\"follow\",{\"follower\":\"\",\"following\":\"\",\"what\":[\"blog\"]}]"
+                    "{\"p\":\"{\"t\":\"{\"d\":{\"t\":\"\",\"m\":\"\",\"i\":\"\",\"a\":\"\",\"s\":";
+
+            struct deflate_stream {
+                z_stream stream = {};
+
+                deflate_stream() {
+                    FC_ASSERT(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+                    deflateSetDictionary(&stream, (const Bytef *)compression_dictionary, sizeof(compression_dictionary) - 1);
+                }
+
+                ~deflate_stream() {
+                    deflateEnd(&stream);
+                }
+            };
+
+            struct inflate_stream {
+                z_stream stream = {};
+
+                inflate_stream() {
+                    FC_ASSERT(inflateInit2(&stream, -MAX_WBITS) == Z_OK);
+                    // raw streams take the dictionary up front, they don't ask for it
+                    inflateSetDictionary(&stream, (const Bytef *)compression_dictionary, sizeof(compression_dictionary) - 1);
+                }
+
+                ~inflate_stream() {
+                    inflateEnd(&stream);
+                }
+            };
+
+        } // detail
+
+        bool compress_message(const message &message_to_compress, message &result) {
+            if (message_to_compress.data.size() < GRAPHENE_NET_MIN_COMPRESSED_MESSAGE_SIZE ||
+                message_to_compress.msg_type == compressed_message::type) {
+                return false;
+            }
+
+            detail::deflate_stream deflater;
+            std::vector<char> deflated(deflateBound(&deflater.stream, (uLong)message_to_compress.data.size()));
+            deflater.stream.next_in = (Bytef *)message_to_compress.data.data();
+            deflater.stream.avail_in = (uInt)message_to_compress.data.size();
+            deflater.stream.next_out = (Bytef *)deflated.data();
+            deflater.stream.avail_out = (uInt)deflated.size();
+            FC_ASSERT(deflate(&deflater.stream, Z_FINISH) == Z_STREAM_END);
+
+            // the wrapper costs a few bytes of its own, don't bother when it barely helps
+            if (deflater.stream.total_out + 16 >= message_to_compress.data.size()) {
+                return false;
+            }
+            deflated.resize(deflater.stream.total_out);
+
+            result = message(compressed_message(message_to_compress.msg_type, (uint32_t)message_to_compress.data.size(), std::move(deflated)));
+            return true;
+        }
+
+        fc::future<shared_message_ptr> compress_message_async(shared_message_ptr message_to_compress) {
+            auto compress = [message_to_compress]() -> shared_message_ptr {
+                auto compressed = std::make_shared<message>();
+                if (!compress_message(*message_to_compress, *compressed)) {
+                    return shared_message_ptr();
+                }
+                return compressed;
+            };
+
+            fc::thread *decode_thread = nullptr;
+            if (message_to_compress->size >= GRAPHENE_NET_MIN_OFFLOADED_MESSAGE_SIZE) {
+                decode_thread = message_oriented_connection::get_decode_thread();
+            }
+            if (decode_thread != nullptr) {
+                return decode_thread->async(compress, "p2p compress");
+            }
+
+            fc::promise<shared_message_ptr>::ptr result(new fc::promise<shared_message_ptr>("p2p compress"));
+            result->set_value(compress());
+            return result;
+        }
+
+        message decompress_message(const message &compressed) {
+            try {
+                compressed_message wrapper = compressed.as<compressed_message>();
+                FC_ASSERT(wrapper.msg_type != compressed_message::type, "Compressed messages can't be nested");
+                FC_ASSERT(wrapper.size <= MAX_MESSAGE_SIZE, "Compressed message is too large: ${size}", ("size", wrapper.size));
+
+                message result;
+                result.msg_type = wrapper.msg_type;
+                result.size = wrapper.size;
+                result.data.resize(wrapper.size);
+
+                detail::inflate_stream inflater;
+                inflater.stream.next_in = (Bytef *)wrapper.data.data();
+                inflater.stream.avail_in = (uInt)wrapper.data.size();
+                inflater.stream.next_out = (Bytef *)result.data.data();
+                inflater.stream.avail_out = (uInt)result.data.size();
+                FC_ASSERT(inflate(&inflater.stream, Z_FINISH) == Z_STREAM_END &&
+                          inflater.stream.total_out == wrapper.size,
+                        "Compressed message doesn't match its size");
+                return result;
+            } FC_CAPTURE_AND_RETHROW((compressed.size))
+        }
+
+    }
+} // graphene::network
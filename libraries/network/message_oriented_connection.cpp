@@ -26,6 +26,9 @@
 #include <fc/thread/scoped_lock.hpp>
 #include <fc/io/enum_type.hpp>
 
+#include <atomic>
+#include <mutex>
+
 #include <graphene/network/message_oriented_connection.hpp>
 #include <graphene/network/stcp_socket.hpp>
 #include <graphene/network/config.hpp>
@@ -176,7 +179,15 @@ namespace graphene {
                                 buffer + sizeof(message_header),
                                 buffer + sizeof(buffer), m.data.begin());
                         if (remaining_bytes_with_padding) {
-                            _sock.read(&m.data[LEFTOVER], remaining_bytes_with_padding);
+                            fc::thread *decode_thread = nullptr;
+                            if (remaining_bytes_with_padding >= GRAPHENE_NET_MIN_OFFLOADED_MESSAGE_SIZE) {
+                                decode_thread = message_oriented_connection::get_decode_thread();
+                            }
+                            if (decode_thread) {
+                                _sock.read_and_decode_on(*decode_thread, &m.data[LEFTOVER], remaining_bytes_with_padding);
+                            } else {
+                                _sock.read(&m.data[LEFTOVER], remaining_bytes_with_padding);
+                            }
                             _bytes_received += remaining_bytes_with_padding;
                         }
                         m.data.resize(m.size); // truncate off the padding bytes
@@ -271,11 +282,13 @@ namespace graphene {
                     //pad the message we send to a multiple of 16 bytes
                     size_t size_with_padding =
                             16 * ((size_of_message_and_header + 15) / 16);
-                    std::unique_ptr<char[]> padded_message(new char[size_with_padding]);
-                    memcpy(padded_message.get(), (char *)&message_to_send, sizeof(message_header));
-                    memcpy(padded_message.get() +
-                           sizeof(message_header), message_to_send.data.data(), message_to_send.size);
-                    _sock.write(padded_message.get(), size_with_padding);
+                    fc::thread *encode_thread = nullptr;
+                    if (size_with_padding >= GRAPHENE_NET_MIN_OFFLOADED_MESSAGE_SIZE) {
+                        encode_thread = message_oriented_connection::get_decode_thread();
+                    }
+                    // header and body are encrypted together into one frame and written at once
+                    _sock.write_frame((const char *)&message_to_send, sizeof(message_header),
+                            message_to_send.data.data(), message_to_send.size, encode_thread);
                     _sock.flush();
                     _bytes_sent += size_with_padding;
                     _last_message_sent_time = fc::time_point::now();
@@ -337,6 +350,10 @@ namespace graphene {
                 return _sock.get_shared_secret();
             }
 
+            static std::mutex decode_threads_mutex;
+            static std::vector<std::unique_ptr<fc::thread>> decode_threads;
+            static std::atomic<uint32_t> next_decode_thread(0);
+
         } // end namespace graphene::network::detail
 
 
@@ -400,5 +417,24 @@ namespace graphene {
             return my->get_shared_secret();
         }
 
+        void message_oriented_connection::set_decode_thread_count(uint32_t count) {
+            std::lock_guard<std::mutex> lock(detail::decode_threads_mutex);
+            for (auto &thread : detail::decode_threads) {
+                thread->quit();
+            }
+            detail::decode_threads.clear();
+            for (uint32_t i = 0; i < count; ++i) {
+                detail::decode_threads.emplace_back(new fc::thread("p2p decode " + std::to_string(i)));
+            }
+        }
+
+        fc::thread *message_oriented_connection::get_decode_thread() {
+            std::lock_guard<std::mutex> lock(detail::decode_threads_mutex);
+            if (detail::decode_threads.empty()) {
+                return nullptr;
+            }
+            return detail::decode_threads[detail::next_decode_thread++ % detail::decode_threads.size()].get();
+        }
+
     }
 } // end namespace graphene::network
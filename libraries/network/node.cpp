@@ -21,6 +21,7 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <deque>
@@ -28,6 +29,7 @@
 #include <list>
 #include <forward_list>
 #include <iostream>
+#include <limits>
 #include <boost/tuple/tuple.hpp>
 #include <boost/circular_buffer.hpp>
 
@@ -64,6 +66,8 @@
 #include <graphene/network/node.hpp>
 #include <graphene/network/peer_connection.hpp>
 #include <graphene/network/exceptions.hpp>
+#include <graphene/network/message_compression.hpp>
+#include <graphene/network/trx_reconciliation.hpp>
 
 #include <fc/git_revision.hpp>
 
@@ -119,37 +123,50 @@ namespace graphene {
                 };
                 struct block_clock_index {
                 };
+                struct message_body_index {
+                };
 
                 struct message_info {
                     message_hash_type message_hash;
-                    message message_body;
+                    shared_message_ptr message_body;
                     uint32_t block_clock_when_received;
 
                     // for network performance stats
                     message_propagation_data propagation_data;
                     fc::uint160_t message_contents_hash; // hash of whatever the message contains (if it's a transaction, this is the transaction id, if it's a block, it's the block_id)
 
+                    // made when the message is sent to the first peer supporting compression
+                    mutable fc::future<shared_message_ptr> compressed_body;
+
                     message_info(const message_hash_type &message_hash,
-                            const message &message_body,
+                            shared_message_ptr message_body,
                             uint32_t block_clock_when_received,
                             const message_propagation_data &propagation_data,
                             fc::uint160_t message_contents_hash) :
                             message_hash(message_hash),
-                            message_body(message_body),
+                            message_body(std::move(message_body)),
                             block_clock_when_received(block_clock_when_received),
                             propagation_data(propagation_data),
                             message_contents_hash(message_contents_hash) {
                     }
+
+                    const message *message_body_address() const {
+                        return message_body.get();
+                    }
                 };
 
                 typedef boost::multi_index_container
                         <message_info,
-                                bmi::indexed_by<bmi::ordered_unique<bmi::tag<message_hash_index>,
-                                        bmi::member<message_info, message_hash_type, &message_info::message_hash>>,
-                                        bmi::ordered_non_unique<bmi::tag<message_contents_hash_index>,
-                                                bmi::member<message_info, fc::uint160_t, &message_info::message_contents_hash>>,
+                                bmi::indexed_by<bmi::hashed_unique<bmi::tag<message_hash_index>,
+                                        bmi::member<message_info, message_hash_type, &message_info::message_hash>,
+                                        std::hash<message_hash_type>>,
+                                        bmi::hashed_non_unique<bmi::tag<message_contents_hash_index>,
+                                                bmi::member<message_info, fc::uint160_t, &message_info::message_contents_hash>,
+                                                std::hash<fc::uint160_t>>,
                                         bmi::ordered_non_unique<bmi::tag<block_clock_index>,
-                                                bmi::member<message_info, uint32_t, &message_info::block_clock_when_received>>>
+                                                bmi::member<message_info, uint32_t, &message_info::block_clock_when_received>>,
+                                        bmi::hashed_non_unique<bmi::tag<message_body_index>,
+                                                bmi::const_mem_fun<message_info, const message *, &message_info::message_body_address>>>
                         > message_cache_container;
 
                 message_cache_container _message_cache;
@@ -163,13 +180,22 @@ namespace graphene {
 
                 void block_accepted();
 
-                void cache_message(const message &message_to_cache, const message_hash_type &hash_of_message_to_cache,
+                void erase_message(const message_hash_type &hash_of_message_to_erase);
+
+                void cache_message(shared_message_ptr message_to_cache, const message_hash_type &hash_of_message_to_cache,
                         const message_propagation_data &propagation_data, const fc::uint160_t &message_content_hash);
 
-                message get_message(const message_hash_type &hash_of_message_to_lookup);
+                /// the cached message is shared, not copied, throws key_not_found_exception if it isn't cached
+                shared_message_ptr get_message(const message_hash_type &hash_of_message_to_lookup) const;
+
+                /// returns nullptr if the transaction isn't cached
+                shared_message_ptr get_transaction_message(const transaction_id_type &id_of_transaction_to_lookup) const;
 
                 message_propagation_data get_message_propagation_data(const fc::uint160_t &hash_of_message_contents_to_lookup) const;
 
+                /// the compressed message is kept with the cached one, a message which isn't cached is compressed for this call only
+                fc::future<shared_message_ptr> get_compressed_message(const shared_message_ptr &message_to_compress) const;
+
                 size_t size() const {
                     return _message_cache.size();
                 }
@@ -184,18 +210,22 @@ namespace graphene {
                 }
             }
 
-            void blockchain_tied_message_cache::cache_message(const message &message_to_cache,
+            void blockchain_tied_message_cache::erase_message(const message_hash_type &hash_of_message_to_erase) {
+                _message_cache.get<message_hash_index>().erase(hash_of_message_to_erase);
+            }
+
+            void blockchain_tied_message_cache::cache_message(shared_message_ptr message_to_cache,
                     const message_hash_type &hash_of_message_to_cache,
                     const message_propagation_data &propagation_data,
                     const fc::uint160_t &message_content_hash) {
                 _message_cache.insert(message_info(hash_of_message_to_cache,
-                        message_to_cache,
+                        std::move(message_to_cache),
                         block_clock,
                         propagation_data,
                         message_content_hash));
             }
 
-            message blockchain_tied_message_cache::get_message(const message_hash_type &hash_of_message_to_lookup) {
+            shared_message_ptr blockchain_tied_message_cache::get_message(const message_hash_type &hash_of_message_to_lookup) const {
                 message_cache_container::index<message_hash_index>::type::const_iterator iter =
                         _message_cache.get<message_hash_index>().find(hash_of_message_to_lookup);
                 if (iter != _message_cache.get<message_hash_index>().end()) {
@@ -204,6 +234,27 @@ namespace graphene {
                 FC_THROW_EXCEPTION(fc::key_not_found_exception, "Requested message not in cache");
             }
 
+            fc::future<shared_message_ptr> blockchain_tied_message_cache::get_compressed_message(const shared_message_ptr &message_to_compress) const {
+                auto iter = _message_cache.get<message_body_index>().find(message_to_compress.get());
+                if (iter == _message_cache.get<message_body_index>().end()) {
+                    return compress_message_async(message_to_compress);
+                }
+                if (!iter->compressed_body.valid()) {
+                    iter->compressed_body = compress_message_async(message_to_compress);
+                }
+                return iter->compressed_body;
+            }
+
+            shared_message_ptr blockchain_tied_message_cache::get_transaction_message(const transaction_id_type &id_of_transaction_to_lookup) const {
+                auto range = _message_cache.get<message_contents_hash_index>().equal_range(id_of_transaction_to_lookup);
+                for (auto iter = range.first; iter != range.second; ++iter) {
+                    if (iter->message_body->msg_type == trx_message_type) {
+                        return iter->message_body;
+                    }
+                }
+                return shared_message_ptr();
+            }
+
             message_propagation_data blockchain_tied_message_cache::get_message_propagation_data(const fc::uint160_t &hash_of_message_contents_to_lookup) const {
                 if (hash_of_message_contents_to_lookup != fc::uint160_t()) {
                     message_cache_container::index<message_contents_hash_index>::type::const_iterator iter =
@@ -216,6 +267,76 @@ namespace graphene {
                 FC_THROW_EXCEPTION(fc::key_not_found_exception, "Requested message not in cache");
             }
 
+            /**
+             *  Fixed size history of accepted block ids, the oldest ids are evicted first.
+             *  Lookups are hashed because they are done for every block pushed during sync.
+             */
+            class recently_accepted_blocks {
+            public:
+                explicit recently_accepted_blocks(size_t capacity)
+                        : _ids(capacity) {
+                }
+
+                void push_back(const item_hash_t &block_id) {
+                    if (_ids.full() && !_ids.empty()) {
+                        auto evicted = _index.find(_ids.front());
+                        if (evicted != _index.end()) {
+                            _index.erase(evicted);
+                        }
+                    }
+                    _ids.push_back(block_id);
+                    _index.insert(block_id);
+                }
+
+                bool contains(const item_hash_t &block_id) const {
+                    return _index.find(block_id) != _index.end();
+                }
+
+                /// forgets a block which turned out to be invalid after it was relayed
+                void erase(const item_hash_t &block_id) {
+                    for (auto &id : _ids) {
+                        if (id == block_id) {
+                            auto erased = _index.find(block_id);
+                            if (erased != _index.end()) {
+                                _index.erase(erased);
+                            }
+                            id = item_hash_t();
+                        }
+                    }
+                }
+
+                void clear() {
+                    _ids.clear();
+                    _index.clear();
+                }
+
+            private:
+                boost::circular_buffer<item_hash_t> _ids;
+                std::unordered_multiset<item_hash_t> _index;
+            };
+
+            /// sync block waiting until it becomes the next block some peer expects us to push
+            struct received_sync_block {
+                uint32_t block_num;
+                item_hash_t block_id;
+                graphene::network::block_message block;
+
+                received_sync_block(graphene::network::block_message &&received_block)
+                        : block_num(received_block.block.block_num()),
+                          block_id(received_block.block_id),
+                          block(std::move(received_block)) {
+                }
+            };
+
+            struct sync_block_id_index {
+            };
+
+            typedef boost::multi_index_container<received_sync_block,
+                    bmi::indexed_by<bmi::hashed_unique<bmi::tag<sync_block_id_index>,
+                            bmi::member<received_sync_block, item_hash_t, &received_sync_block::block_id>,
+                            std::hash<item_hash_t>>>
+            > received_sync_block_container;
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
             // This specifies configuration info for the local node.  It's stored as JSON
@@ -289,9 +410,12 @@ namespace graphene {
 #define NODE_DELEGATE_METHOD_NAMES (has_item) \
                                    (handle_message) \
                                    (handle_block) \
+                                   (prevalidate_sync_blocks) \
+                                   (prevalidate_block_for_relay) \
                                    (handle_transaction) \
                                    (get_block_ids) \
                                    (get_item) \
+                                   (get_block_range) \
                                    (get_blockchain_synopsis) \
                                    (sync_status) \
                                    (connection_count_changed) \
@@ -391,6 +515,10 @@ namespace graphene {
 
                 bool handle_block(const graphene::network::block_message &block_message, bool sync_mode, std::vector<fc::uint160_t> &contained_transaction_message_ids) override;
 
+                void prevalidate_sync_blocks(const std::vector<graphene::protocol::signed_block_header> &headers) override;
+
+                void prevalidate_block_for_relay(const graphene::network::block_message &block_message) override;
+
                 void handle_transaction(const graphene::network::trx_message &transaction_message) override;
 
                 std::vector<item_hash_t> get_block_ids(const std::vector<item_hash_t> &blockchain_synopsis,
@@ -399,6 +527,8 @@ namespace graphene {
 
                 message get_item(const item_id &id) override;
 
+                std::vector<message> get_block_range(const item_hash_t &first_block, uint32_t count) override;
+
                 std::vector<item_hash_t> get_blockchain_synopsis(const item_hash_t &reference_point,
                         uint32_t number_of_blocks_after_reference_point) override;
 
@@ -429,7 +559,8 @@ namespace graphene {
                 std::unique_ptr<statistics_gathering_node_delegate_wrapper> _delegate;
 
 #define NODE_CONFIGURATION_FILENAME      "node_config.json"
-#define POTENTIAL_PEER_DATABASE_FILENAME "peers.json"
+#define POTENTIAL_PEER_DATABASE_FILENAME "peers.dat"
+#define LEGACY_POTENTIAL_PEER_DATABASE_FILENAME "peers.json"
                 fc::path _node_configuration_directory;
                 node_configuration _node_configuration;
 
@@ -447,6 +578,7 @@ namespace graphene {
                 /// used by the task that manages connecting to peers
                 // @{
                 std::list<potential_peer_record> _add_once_node_list; /// list of peers we want to connect to as soon as possible
+                std::unordered_map<item_hash_t, fc::time_point> _block_announcement_times; /// when the first peer announced each recent block, to rate how fast peers relay them
 
                 peer_database _potential_peer_db;
                 fc::promise<void>::ptr _retrigger_connect_loop_promise;
@@ -464,7 +596,7 @@ namespace graphene {
 
                 active_sync_requests_map _active_sync_requests; /// list of sync blocks we've asked for from peers but have not yet received
                 std::list<graphene::network::block_message> _new_received_sync_items; /// list of sync blocks we've just received but haven't yet tried to process
-                std::list<graphene::network::block_message> _received_sync_items; /// list of sync blocks we've received, but can't yet process because we are still missing blocks that come earlier in the chain
+                received_sync_block_container _received_sync_items; /// sync blocks we've received, but can't yet process because we are still missing blocks that come earlier in the chain
                 // @}
 
                 fc::future<void> _process_backlog_of_sync_blocks_done;
@@ -496,6 +628,12 @@ namespace graphene {
                 std::unordered_set<item_id> _new_inventory; /// list of items we have received but not yet advertised to our peers
                 // @}
 
+                /// used by the task that reconciles transaction inventory with peers supporting it
+                // @{
+                uint64_t _trx_reconciliation_salt; /// our part of the salt of short transaction ids, sent in hello
+                fc::future<void> _trx_reconciliation_loop_done;
+                // @}
+
                 fc::future<void> _terminate_inactive_connections_loop_done;
                 uint8_t _recent_block_interval_in_seconds; // a cached copy of the block interval, to avoid a thread hop to the blockchain to get the current value
 
@@ -537,7 +675,7 @@ namespace graphene {
                 /** stores connections we've closed, but are still waiting for the OS to notify us that the socket is really closed */
                 std::unordered_set<peer_connection_ptr> _terminating_connections;
 
-                boost::circular_buffer<item_hash_t> _most_recent_blocks_accepted; // the /n/ most recent blocks we've accepted (currently tuned to the max number of connections)
+                recently_accepted_blocks _most_recent_blocks_accepted; // the /n/ most recent blocks we've accepted (currently tuned to the max number of connections)
 
                 uint32_t _sync_item_type;
                 uint32_t _total_number_of_unfetched_items; /// the number of items we still need to fetch while syncing
@@ -591,6 +729,7 @@ namespace graphene {
                 unsigned _maximum_number_of_blocks_to_handle_at_one_time;
                 unsigned _maximum_number_of_sync_blocks_to_prefetch;
                 unsigned _maximum_blocks_per_peer_during_syncing;
+                bool _header_first_relay; /// relay blocks once the delegate prevalidated them, before they are applied
 
                 std::list<fc::future<void>> _handle_message_calls_in_progress;
                 std::set<message_hash_type> _message_ids_currently_being_processed;
@@ -605,11 +744,18 @@ namespace graphene {
 
                 void trigger_p2p_network_connect_loop();
 
+                /// applies update to the database record of the peer, if it has one
+                void update_peer_record(peer_connection *peer, const std::function<void(potential_peer_record &)> &update);
+
+                void record_block_announcement(peer_connection *peer, const item_hash_t &block_message_hash);
+
                 bool have_already_received_sync_item(const item_hash_t &item_hash);
 
                 void request_sync_item_from_peer(const peer_connection_ptr &peer, const item_hash_t &item_to_request);
 
-                void request_sync_items_from_peer(const peer_connection_ptr &peer, const std::vector<item_hash_t> &items_to_request);
+                void request_sync_items_from_peer(const peer_connection_ptr &peer, const std::vector<item_hash_t> &items_to_request, bool consecutive = false);
+
+                uint32_t get_sync_request_size(const peer_connection_ptr &peer) const;
 
                 void fetch_sync_items_loop();
 
@@ -625,6 +771,10 @@ namespace graphene {
 
                 void trigger_advertise_inventory_loop();
 
+                void trx_reconciliation_loop();
+
+                void advertise_reconciled_transactions(peer_connection *peer, const std::vector<item_hash_t> &trx_message_ids);
+
                 void terminate_inactive_connections_loop();
 
                 void fetch_updated_peer_lists_loop();
@@ -715,6 +865,32 @@ namespace graphene {
                 void on_get_current_connections_reply_message(peer_connection *originating_peer,
                         const get_current_connections_reply_message &get_current_connections_reply_message_received);
 
+                void on_compact_block_message(peer_connection *originating_peer,
+                        const compact_block_message &compact_block_message_received);
+
+                void on_fetch_compact_block_transactions_message(peer_connection *originating_peer,
+                        const fetch_compact_block_transactions_message &fetch_compact_block_transactions_message_received);
+
+                void on_compact_block_transactions_message(peer_connection *originating_peer,
+                        const compact_block_transactions_message &compact_block_transactions_message_received);
+
+                void process_compact_block(peer_connection *originating_peer,
+                        const peer_connection::partial_compact_block &compact_block_to_process);
+
+                void send_compact_blocks(peer_connection *originating_peer, const std::vector<item_hash_t> &block_message_hashes);
+
+                void on_fetch_sync_block_range_message(peer_connection *originating_peer,
+                        const fetch_sync_block_range_message &fetch_sync_block_range_message_received);
+
+                void on_trx_reconciliation_request_message(peer_connection *originating_peer,
+                        const trx_reconciliation_request_message &trx_reconciliation_request_message_received);
+
+                void on_trx_reconciliation_sketch_message(peer_connection *originating_peer,
+                        const trx_reconciliation_sketch_message &trx_reconciliation_sketch_message_received);
+
+                void on_trx_reconciliation_result_message(peer_connection *originating_peer,
+                        const trx_reconciliation_result_message &trx_reconciliation_result_message_received);
+
                 void on_connection_closed(peer_connection *originating_peer) override;
 
                 void send_sync_block_to_node_delegate(const graphene::network::block_message &block_message_to_send);
@@ -727,6 +903,9 @@ namespace graphene {
 
                 void process_block_during_normal_operation(peer_connection *originating_peer, const graphene::network::block_message &block_message, const message_hash_type &message_hash);
 
+                void relay_block(peer_connection *originating_peer, const graphene::network::block_message &block_message,
+                        const message_hash_type &message_hash, fc::time_point message_receive_time, fc::time_point message_validated_time);
+
                 void process_block_message(peer_connection *originating_peer, const message &message_to_process, const message_hash_type &message_hash);
 
                 void process_ordinary_message(peer_connection *originating_peer, const message &message_to_process, const message_hash_type &message_hash);
@@ -825,7 +1004,9 @@ namespace graphene {
 
                 fc::variant_object get_call_statistics() const;
 
-                message get_message_for_item(const item_id &item) override;
+                shared_message_ptr get_message_for_item(const item_id &item) override;
+
+                fc::future<shared_message_ptr> get_compressed_message(const shared_message_ptr &message_to_compress) override;
 
                 fc::variant_object network_get_info() const;
 
@@ -899,9 +1080,11 @@ namespace graphene {
                     _node_is_shutting_down(false),
                     _maximum_number_of_blocks_to_handle_at_one_time(MAXIMUM_NUMBER_OF_BLOCKS_TO_HANDLE_AT_ONE_TIME),
                     _maximum_number_of_sync_blocks_to_prefetch(MAXIMUM_NUMBER_OF_BLOCKS_TO_PREFETCH),
-                    _maximum_blocks_per_peer_during_syncing(GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING) {
+                    _maximum_blocks_per_peer_during_syncing(GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING),
+                    _header_first_relay(false) {
                 _rate_limiter.set_actual_rate_time_constant(fc::seconds(2));
                 fc::rand_pseudo_bytes(&_node_id.data[0], (int)_node_id.size());
+                fc::rand_pseudo_bytes((char *)&_trx_reconciliation_salt, sizeof(_trx_reconciliation_salt));
             }
 
             node_impl::~node_impl() {
@@ -979,29 +1162,40 @@ namespace graphene {
                             bool initiated_connection_this_pass = false;
                             _potential_peer_database_updated = false;
 
-                            for (peer_database::iterator iter = _potential_peer_db.begin();
-                                 iter != _potential_peer_db.end() &&
-                                 is_wanting_new_connections();
-                                 ++iter) {
-                                fc::microseconds delay_until_retry = fc::seconds(
-                                        (iter->number_of_failed_connection_attempts +
-                                         1) * _peer_connection_retry_timeout);
-
-                                if (!is_connection_to_endpoint_in_progress(iter->endpoint) &&
-                                    ((iter->last_connection_disposition !=
-                                      last_connection_failed &&
-                                      iter->last_connection_disposition !=
-                                      last_connection_rejected &&
-                                      iter->last_connection_disposition !=
-                                      last_connection_handshaking_failed) ||
-                                     (fc::time_point::now() -
-                                      iter->last_connection_attempt_time) >
-                                     delay_until_retry)) {
-                                    connect_to_endpoint(iter->endpoint);
-                                    initiated_connection_this_pass = true;
+                            std::set<uint32_t> connected_subnets;
+                            for (const peer_connection_ptr &peer : _active_connections) {
+                                fc::optional<fc::ip::endpoint> remote_endpoint = peer->get_remote_endpoint();
+                                if (remote_endpoint) {
+                                    connected_subnets.insert(peer_database::get_subnet(remote_endpoint->get_address()));
                                 }
                             }
 
+                            std::vector<fc::ip::endpoint> candidates = _potential_peer_db.get_connection_candidates(
+                                    [this](const potential_peer_record &record) {
+                                        fc::microseconds delay_until_retry = fc::seconds(
+                                                (record.number_of_failed_connection_attempts +
+                                                 1) * _peer_connection_retry_timeout);
+
+                                        return !is_connection_to_endpoint_in_progress(record.endpoint) &&
+                                               ((record.last_connection_disposition !=
+                                                 last_connection_failed &&
+                                                 record.last_connection_disposition !=
+                                                 last_connection_rejected &&
+                                                 record.last_connection_disposition !=
+                                                 last_connection_handshaking_failed) ||
+                                                (fc::time_point::now() -
+                                                 record.last_connection_attempt_time) >
+                                                delay_until_retry);
+                                    }, std::move(connected_subnets));
+
+                            for (const fc::ip::endpoint &candidate : candidates) {
+                                if (!is_wanting_new_connections()) {
+                                    break;
+                                }
+                                connect_to_endpoint(candidate);
+                                initiated_connection_this_pass = true;
+                            }
+
                             if (!initiated_connection_this_pass &&
                                 !_potential_peer_database_updated) {
                                     break;
@@ -1054,12 +1248,45 @@ namespace graphene {
                 //  _retrigger_connect_loop_promise->set_value();
             }
 
+            void node_impl::update_peer_record(peer_connection *peer, const std::function<void(potential_peer_record &)> &update) {
+                VERIFY_CORRECT_THREAD();
+                fc::optional<fc::ip::endpoint> inbound_endpoint = peer->get_endpoint_for_connecting();
+                if (inbound_endpoint) {
+                    fc::optional<potential_peer_record> updated_peer_record = _potential_peer_db.lookup_entry_for_endpoint(*inbound_endpoint);
+                    if (updated_peer_record) {
+                        update(*updated_peer_record);
+                        _potential_peer_db.update_entry(*updated_peer_record);
+                    }
+                }
+            }
+
+            void node_impl::record_block_announcement(peer_connection *peer, const item_hash_t &block_message_hash) {
+                VERIFY_CORRECT_THREAD();
+                fc::time_point now = fc::time_point::now();
+                if (_block_announcement_times.size() >= GRAPHENE_NET_MESSAGE_CACHE_DURATION_IN_BLOCKS * 100) {
+                    // blocks are announced within seconds, older announcements don't matter anymore
+                    for (auto itr = _block_announcement_times.begin(); itr != _block_announcement_times.end();) {
+                        if (now - itr->second > fc::minutes(1)) {
+                            itr = _block_announcement_times.erase(itr);
+                        } else {
+                            ++itr;
+                        }
+                    }
+                    if (_block_announcement_times.size() >= GRAPHENE_NET_MESSAGE_CACHE_DURATION_IN_BLOCKS * 100) {
+                        _block_announcement_times.clear();
+                    }
+                }
+
+                auto first_announcement = _block_announcement_times.emplace(block_message_hash, now).first;
+                fc::microseconds lag = now - first_announcement->second;
+                update_peer_record(peer, [&](potential_peer_record &record) {
+                    record.record_block_announcement(lag);
+                });
+            }
+
             bool node_impl::have_already_received_sync_item(const item_hash_t &item_hash) {
                 VERIFY_CORRECT_THREAD();
-                return std::find_if(_received_sync_items.begin(), _received_sync_items.end(),
-                        [&item_hash](const graphene::network::block_message &message) {
-                            return message.block_id == item_hash;
-                        }) != _received_sync_items.end() ||
+                return _received_sync_items.get<sync_block_id_index>().count(item_hash) != 0 ||
                        std::find_if(_new_received_sync_items.begin(), _new_received_sync_items.end(),
                                [&item_hash](const graphene::network::block_message &message) {
                                    return message.block_id == item_hash;
@@ -1078,16 +1305,40 @@ namespace graphene {
                 }));
             }
 
-            void node_impl::request_sync_items_from_peer(const peer_connection_ptr &peer, const std::vector<item_hash_t> &items_to_request) {
+            void node_impl::request_sync_items_from_peer(const peer_connection_ptr &peer, const std::vector<item_hash_t> &items_to_request, bool consecutive) {
                 VERIFY_CORRECT_THREAD();
                 dlog("requesting ${item_count} item(s) ${items_to_request} from peer ${endpoint}",
                         ("item_count", items_to_request.size())("items_to_request", items_to_request)("endpoint", peer->get_remote_endpoint()));
+                fc::time_point now = fc::time_point::now();
                 for (const item_hash_t &item_to_request : items_to_request) {
-                    _active_sync_requests.insert(active_sync_requests_map::value_type(item_to_request, fc::time_point::now()));
-                    peer->last_sync_item_received_time = fc::time_point::now();
+                    // a straggler requested again keeps its entry, but the time is restarted
+                    _active_sync_requests[item_to_request] = now;
+                    peer->last_sync_item_received_time = now;
                     peer->sync_items_requested_from_peer.insert(item_to_request);
                 }
-                peer->send_message(fetch_items_message(graphene::network::block_message_type, items_to_request));
+                peer->sync_request_sent_time = now;
+                peer->sync_request_size = (uint32_t)items_to_request.size();
+                peer->sync_request_is_range = consecutive && items_to_request.size() > 1 && peer->supports_block_ranges;
+                if (peer->sync_request_is_range) {
+                    peer->send_message(fetch_sync_block_range_message(items_to_request.front(), (uint32_t)items_to_request.size()));
+                } else {
+                    peer->send_message(fetch_items_message(graphene::network::block_message_type, items_to_request));
+                }
+            }
+
+            uint32_t node_impl::get_sync_request_size(const peer_connection_ptr &peer) const {
+                VERIFY_CORRECT_THREAD();
+                uint32_t max_request_size = std::max<uint32_t>(_maximum_blocks_per_peer_during_syncing, 1);
+                if (peer->supports_block_ranges) {
+                    // the peer serves at most this many blocks of a range, don't ask for more
+                    max_request_size = std::min<uint32_t>(max_request_size, GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING);
+                }
+                uint32_t min_request_size = std::min<uint32_t>(GRAPHENE_NET_MIN_BLOCKS_PER_PEER_DURING_SYNCING, max_request_size);
+                if (peer->sync_block_rate == 0) {
+                    return min_request_size;
+                }
+                uint64_t request_size = uint64_t(peer->sync_block_rate) * GRAPHENE_NET_SYNC_REQUEST_TARGET_DURATION_SEC;
+                return (uint32_t)std::max<uint64_t>(min_request_size, std::min<uint64_t>(max_request_size, request_size));
             }
 
             void node_impl::fetch_sync_items_loop() {
@@ -1097,11 +1348,17 @@ namespace graphene {
                     dlog("beginning another iteration of the sync items loop");
 
                     if (!_suspend_fetching_sync_blocks) {
-                        std::map<peer_connection_ptr, std::vector<item_hash_t>> sync_item_requests_to_send;
+                        struct sync_item_request {
+                            std::vector<item_hash_t> items;
+                            bool consecutive = true;
+                            unsigned last_index = 0;
+                        };
+                        std::map<peer_connection_ptr, sync_item_request> sync_item_requests_to_send;
 
                         {
                             ASSERT_TASK_NOT_PREEMPTED();
                             std::set<item_hash_t> sync_items_to_request;
+                            fc::time_point straggler_request_time = fc::time_point::now() - fc::seconds(GRAPHENE_NET_SYNC_STRAGGLER_TIMEOUT_SEC);
 
                             // for each idle peer that we're syncing with
                             for (const peer_connection_ptr &peer : _active_connections) {
@@ -1111,25 +1368,39 @@ namespace graphene {
                                     // if we've already scheduled a request for this peer, don't consider scheduling another
                                     peer->idle()) {
                                     if (!peer->inhibit_fetching_sync_blocks) {
+                                        // faster peers get larger ranges, so no peer holds up the blocks we need next for long
+                                        uint32_t request_size = get_sync_request_size(peer);
                                         // loop through the items it has that we don't yet have on our blockchain
                                         for (unsigned i = 0; i <
                                                              peer->ids_of_items_to_get.size(); ++i) {
                                             item_hash_t item_to_potentially_request = peer->ids_of_items_to_get[i];
+                                            auto active_request_iter = _active_sync_requests.find(item_to_potentially_request);
+                                            // the next block we need is still awaited from a slow peer, ask this idle one too
+                                            bool is_straggler = i == 0 &&
+                                                                active_request_iter != _active_sync_requests.end() &&
+                                                                active_request_iter->second < straggler_request_time;
                                             // if we don't already have this item in our temporary storage and we haven't requested from another syncing peer
                                             if (!have_already_received_sync_item(item_to_potentially_request) &&
                                                 // already got it, but for some reson it's still in our list of items to fetch
                                                 sync_items_to_request.find(item_to_potentially_request) ==
                                                 sync_items_to_request.end() &&
                                                 // we have already decided to request it from another peer during this iteration
-                                                _active_sync_requests.find(item_to_potentially_request) ==
-                                                _active_sync_requests.end()) // we've requested it in a previous iteration and we're still waiting for it to arrive
+                                                (active_request_iter == _active_sync_requests.end() || is_straggler)) // we've requested it in a previous iteration and we're still waiting for it to arrive
                                             {
                                                 // then schedule a request from this peer
-                                                sync_item_requests_to_send[peer].push_back(item_to_potentially_request);
+                                                sync_item_request &request = sync_item_requests_to_send[peer];
+                                                if (!request.items.empty() && i != request.last_index + 1) {
+                                                    request.consecutive = false;
+                                                }
+                                                request.items.push_back(item_to_potentially_request);
+                                                request.last_index = i;
                                                 sync_items_to_request.insert(item_to_potentially_request);
-                                                if (sync_item_requests_to_send[peer].size() >=
-                                                    _maximum_blocks_per_peer_during_syncing) {
-                                                        break;
+                                                if (is_straggler) {
+                                                    dlog("requesting straggling sync item ${item} again from peer ${endpoint}",
+                                                            ("item", item_to_potentially_request)("endpoint", peer->get_remote_endpoint()));
+                                                }
+                                                if (request.items.size() >= request_size) {
+                                                    break;
                                                 }
                                             }
                                         }
@@ -1139,8 +1410,9 @@ namespace graphene {
                         } // end non-preemptable section
 
                         // make all the requests we scheduled in the loop above
-                        for (auto sync_item_request : sync_item_requests_to_send) {
-                            request_sync_items_from_peer(sync_item_request.first, sync_item_request.second);
+                        for (auto &sync_item_request : sync_item_requests_to_send) {
+                            request_sync_items_from_peer(sync_item_request.first, sync_item_request.second.items,
+                                    sync_item_request.second.consecutive);
                         }
                         sync_item_requests_to_send.clear();
                     } else
@@ -1149,7 +1421,17 @@ namespace graphene {
                     if (!_sync_items_to_fetch_updated) {
                         dlog("no sync items to fetch right now, going to sleep");
                         _retrigger_fetch_sync_items_loop_promise = fc::promise<void>::ptr(new fc::promise<void>("graphene::network::retrigger_fetch_sync_items_loop"));
-                        _retrigger_fetch_sync_items_loop_promise->wait();
+                        try {
+                            if (_active_sync_requests.empty()) {
+                                _retrigger_fetch_sync_items_loop_promise->wait();
+                            } else {
+                                // wake up to look for stragglers even if nothing else happens
+                                _retrigger_fetch_sync_items_loop_promise->wait(fc::seconds(GRAPHENE_NET_SYNC_STRAGGLER_TIMEOUT_SEC));
+                            }
+                        }
+                        catch (const fc::timeout_exception &) {
+                            dlog("Resuming fetch_sync_items_loop due to timeout to check for straggling sync items");
+                        }
                         _retrigger_fetch_sync_items_loop_promise.reset();
                     }
                 } // while( !canceled )
@@ -1288,7 +1570,14 @@ namespace graphene {
                                     }
                             }
 
-                            peer_and_items.peer->send_message(fetch_items_message(items_by_type.first,
+                            // blocks are requested without transactions we are likely to have already
+                            uint32_t item_type_to_request = items_by_type.first;
+                            if (item_type_to_request == core_message_type_enum::block_message_type &&
+                                peer_and_items.peer->supports_compact_blocks) {
+                                    item_type_to_request = core_message_type_enum::compact_block_message_type;
+                            }
+
+                            peer_and_items.peer->send_message(fetch_items_message(item_type_to_request,
                                     items_by_type.second));
                         }
                     }
@@ -1335,16 +1624,30 @@ namespace graphene {
                     // first, then send them all in a batch (to avoid any fiber interruption points while
                     // we're computing the messages)
                     std::list<std::pair<peer_connection_ptr, item_ids_inventory_message>> inventory_messages_to_send;
+                    unsigned trx_flood_peers = 0;
 
                     for (const peer_connection_ptr &peer : _active_connections) {
                         // only advertise to peers who are in sync with us
                         //wdump((peer->peer_needs_sync_items_from_us));
                         if (!peer->peer_needs_sync_items_from_us) {
+                            // transactions are flooded to a few outbound peers, the rest of the peers
+                            // supporting reconciliation get them from the next reconciliation round
+                            bool reconcile_transactions = false;
+                            if (peer->supports_trx_reconciliation) {
+                                if (peer->direction == peer_connection_direction::outbound &&
+                                    trx_flood_peers < GRAPHENE_NET_TRX_FLOOD_PEERS) {
+                                    ++trx_flood_peers;
+                                } else {
+                                    reconcile_transactions = true;
+                                }
+                            }
+
                             std::map<uint32_t, std::vector<item_hash_t>> items_to_advertise_by_type;
                             // don't send the peer anything we've already advertised to it
                             // or anything it has advertised to us
                             // group the items we need to send by type, because we'll need to send one inventory message per type
                             unsigned total_items_to_send_to_this_peer = 0;
+                            unsigned total_items_to_reconcile_with_this_peer = 0;
                             //wdump((inventory_to_advertise));
                             for (const item_id &item_to_advertise : inventory_to_advertise) {
                                 //if (peer->inventory_advertised_to_peer.find(item_to_advertise) != peer->inventory_advertised_to_peer.end() )
@@ -1356,8 +1659,16 @@ namespace graphene {
                                     peer->inventory_advertised_to_peer.end() &&
                                     peer->inventory_peer_advertised_to_us.find(item_to_advertise) ==
                                     peer->inventory_peer_advertised_to_us.end()) {
-                                    items_to_advertise_by_type[item_to_advertise.item_type].push_back(item_to_advertise.item_hash);
                                     peer->inventory_advertised_to_peer.insert(peer_connection::timestamped_item_id(item_to_advertise, fc::time_point::now()));
+                                    // a full set or a short id collision make us flood the transaction
+                                    if (reconcile_transactions && item_to_advertise.item_type == trx_message_type &&
+                                        peer->trx_reconciliation_set.size() < GRAPHENE_NET_MAX_TRX_RECONCILIATION_SET_SIZE &&
+                                        peer->trx_reconciliation_set.emplace(get_short_trx_id(peer->trx_reconciliation_salt, item_to_advertise.item_hash),
+                                                item_to_advertise.item_hash).second) {
+                                        ++total_items_to_reconcile_with_this_peer;
+                                        continue;
+                                    }
+                                    items_to_advertise_by_type[item_to_advertise.item_type].push_back(item_to_advertise.item_hash);
                                     ++total_items_to_send_to_this_peer;
                                     if (item_to_advertise.item_type ==
                                         trx_message_type)
@@ -1365,10 +1676,11 @@ namespace graphene {
                                     dlog("advertising item ${id} to peer ${endpoint}", ("id", item_to_advertise.item_hash)("endpoint", peer->get_remote_endpoint()));
                                 }
                             }
-                            dlog("advertising ${count} new item(s) of ${types} type(s) to peer ${endpoint}",
+                            dlog("advertising ${count} new item(s) of ${types} type(s) to peer ${endpoint}, ${reconciled} left for reconciliation",
                                     ("count", total_items_to_send_to_this_peer)
                                             ("types", items_to_advertise_by_type.size())
-                                            ("endpoint", peer->get_remote_endpoint()));
+                                            ("endpoint", peer->get_remote_endpoint())
+                                            ("reconciled", total_items_to_reconcile_with_this_peer));
                             for (auto items_group : items_to_advertise_by_type) {
                                 inventory_messages_to_send.push_back(std::make_pair(peer, item_ids_inventory_message(items_group.first, items_group.second)));
                             }
@@ -1397,6 +1709,51 @@ namespace graphene {
                 }
             }
 
+            void node_impl::trx_reconciliation_loop() {
+                VERIFY_CORRECT_THREAD();
+                const fc::microseconds reconciliation_interval = fc::milliseconds(GRAPHENE_NET_TRX_RECONCILIATION_INTERVAL_MS);
+                fc::time_point now = fc::time_point::now();
+
+                // the side which opened the connection starts the rounds
+                std::vector<peer_connection_ptr> peers_to_reconcile_with;
+                for (const peer_connection_ptr &peer : _active_connections) {
+                    if (!peer->supports_trx_reconciliation ||
+                        peer->direction != peer_connection_direction::outbound ||
+                        now - peer->last_trx_reconciliation_time < reconciliation_interval) {
+                        continue;
+                    }
+                    // give up on a round the peer never answered after a while
+                    if (peer->trx_reconciliation_requested &&
+                        now - peer->last_trx_reconciliation_time < reconciliation_interval * 10) {
+                        continue;
+                    }
+                    peer->trx_reconciliation_requested = true;
+                    peer->last_trx_reconciliation_time = now;
+                    peers_to_reconcile_with.push_back(peer);
+                }
+
+                for (const peer_connection_ptr &peer : peers_to_reconcile_with) {
+                    peer->send_message(trx_reconciliation_request_message((uint32_t)peer->trx_reconciliation_set.size(),
+                            peer->trx_reconciliation_q_per_mille));
+                }
+
+                if (!_node_is_shutting_down &&
+                    !_trx_reconciliation_loop_done.canceled()) {
+                        _trx_reconciliation_loop_done = fc::schedule([=]() { trx_reconciliation_loop(); },
+                                fc::time_point::now() + reconciliation_interval / 4,
+                                "trx_reconciliation_loop");
+                }
+            }
+
+            void node_impl::advertise_reconciled_transactions(peer_connection *peer, const std::vector<item_hash_t> &trx_message_ids) {
+                VERIFY_CORRECT_THREAD();
+                if (!trx_message_ids.empty()) {
+                    dlog("advertising ${count} reconciled transaction(s) to peer ${endpoint}",
+                            ("count", trx_message_ids.size())("endpoint", peer->get_remote_endpoint()));
+                    peer->send_message(item_ids_inventory_message(trx_message_type, trx_message_ids));
+                }
+            }
+
             void node_impl::terminate_inactive_connections_loop() {
                 VERIFY_CORRECT_THREAD();
                 std::list<peer_connection_ptr> peers_to_disconnect_gently;
@@ -1883,7 +2240,9 @@ namespace graphene {
 
             void node_impl::on_message(peer_connection *originating_peer, const message &received_message) {
                 VERIFY_CORRECT_THREAD();
-                message_hash_type message_hash = received_message.id();
+                message_hash_type message_hash = run_decode_task(received_message.size, [&]() {
+                    return received_message.id();
+                });
                 dlog("handling message ${type} ${hash} size ${size} from peer ${endpoint}",
                         ("type", graphene::network::core_message_type_enum(received_message.msg_type))("hash", message_hash)
                                 ("size", received_message.size)
@@ -1943,6 +2302,29 @@ namespace graphene {
                     case core_message_type_enum::get_current_connections_reply_message_type:
                         on_get_current_connections_reply_message(originating_peer, received_message.as<get_current_connections_reply_message>());
                         break;
+                    case core_message_type_enum::compact_block_message_type:
+                        on_compact_block_message(originating_peer, received_message.as<compact_block_message>());
+                        break;
+                    case core_message_type_enum::fetch_compact_block_transactions_message_type:
+                        on_fetch_compact_block_transactions_message(originating_peer, received_message.as<fetch_compact_block_transactions_message>());
+                        break;
+                    case core_message_type_enum::fetch_sync_block_range_message_type:
+                        on_fetch_sync_block_range_message(originating_peer, received_message.as<fetch_sync_block_range_message>());
+                        break;
+                    case core_message_type_enum::trx_reconciliation_request_message_type:
+                        on_trx_reconciliation_request_message(originating_peer, received_message.as<trx_reconciliation_request_message>());
+                        break;
+                    case core_message_type_enum::trx_reconciliation_sketch_message_type:
+                        on_trx_reconciliation_sketch_message(originating_peer, received_message.as<trx_reconciliation_sketch_message>());
+                        break;
+                    case core_message_type_enum::trx_reconciliation_result_message_type:
+                        on_trx_reconciliation_result_message(originating_peer, received_message.as<trx_reconciliation_result_message>());
+                        break;
+                    case core_message_type_enum::compact_block_transactions_message_type:
+                        on_compact_block_transactions_message(originating_peer, run_decode_task(received_message.size, [&]() {
+                            return received_message.as<compact_block_transactions_message>();
+                        }));
+                        break;
 
                     default:
                         // ignore any message in between core_message_type_first and _last that we don't handle above
@@ -1990,6 +2372,13 @@ namespace graphene {
                 }
 
                 user_data["chain_id"] = CHAIN_ID;
+                user_data["compact_blocks"] = true;
+                user_data["block_ranges"] = true;
+                user_data["compression"] = GRAPHENE_NET_COMPRESSION_ALGORITHM;
+                user_data["trx_reconciliation"] = _trx_reconciliation_salt;
+                if (_header_first_relay) {
+                    user_data["header_first_relay"] = true;
+                }
 
                 return user_data;
             }
@@ -2024,6 +2413,25 @@ namespace graphene {
                 if (user_data.contains("chain_id")) {
                     originating_peer->chain_id = user_data["chain_id"].as<graphene::protocol::chain_id_type>();
                 }
+                if (user_data.contains("compact_blocks")) {
+                    originating_peer->supports_compact_blocks = user_data["compact_blocks"].as_bool();
+                }
+                if (user_data.contains("block_ranges")) {
+                    originating_peer->supports_block_ranges = user_data["block_ranges"].as_bool();
+                }
+                if (user_data.contains("header_first_relay")) {
+                    originating_peer->relays_header_first = user_data["header_first_relay"].as_bool();
+                }
+                if (user_data.contains("compression")) {
+                    // both ends have to use the same preset dictionary, which is part of the name
+                    originating_peer->supports_compression =
+                            user_data["compression"].as_string() == GRAPHENE_NET_COMPRESSION_ALGORITHM;
+                }
+                if (user_data.contains("trx_reconciliation")) {
+                    originating_peer->supports_trx_reconciliation = true;
+                    originating_peer->trx_reconciliation_salt = get_trx_reconciliation_salt(_trx_reconciliation_salt,
+                            user_data["trx_reconciliation"].as<uint64_t>());
+                }
             }
 
             void node_impl::on_hello_message(peer_connection *originating_peer, const hello_message &hello_message_received) {
@@ -2813,18 +3221,23 @@ namespace graphene {
                 }
             }
 
-            message node_impl::get_message_for_item(const item_id &item) {
+            shared_message_ptr node_impl::get_message_for_item(const item_id &item) {
                 try {
                     return _message_cache.get_message(item.item_hash);
                 }
                 catch (fc::key_not_found_exception &) {
                 }
                 try {
-                    return _delegate->get_item(item);
+                    return std::make_shared<const message>(_delegate->get_item(item));
                 }
                 catch (fc::key_not_found_exception &) {
                 }
-                return item_not_available_message(item);
+                return std::make_shared<const message>(item_not_available_message(item));
+            }
+
+            fc::future<shared_message_ptr> node_impl::get_compressed_message(const shared_message_ptr &message_to_compress) {
+                VERIFY_CORRECT_THREAD();
+                return _message_cache.get_compressed_message(message_to_compress);
             }
 
             void node_impl::on_fetch_items_message(peer_connection *originating_peer, const fetch_items_message &fetch_items_message_received) {
@@ -2834,15 +3247,20 @@ namespace graphene {
                                 ("type", fetch_items_message_received.item_type)
                                 ("endpoint", originating_peer->get_remote_endpoint()));
 
-                fc::optional<message> last_block_message_sent;
+                if (fetch_items_message_received.item_type == compact_block_message_type) {
+                    send_compact_blocks(originating_peer, fetch_items_message_received.items_to_fetch);
+                    return;
+                }
+
+                shared_message_ptr last_block_message_sent;
 
-                std::list<message> reply_messages;
+                std::list<shared_message_ptr> reply_messages;
                 for (const item_hash_t &item_hash : fetch_items_message_received.items_to_fetch) {
                     try {
-                        message requested_message = _message_cache.get_message(item_hash);
+                        shared_message_ptr requested_message = _message_cache.get_message(item_hash);
                         dlog("received item request for item ${id} from peer ${endpoint}, returning the item from my message cache",
                                 ("endpoint", originating_peer->get_remote_endpoint())
-                                        ("id", requested_message.id()));
+                                        ("id", item_hash));
                         reply_messages.push_back(requested_message);
                         if (fetch_items_message_received.item_type ==
                             block_message_type) {
@@ -2856,10 +3274,10 @@ namespace graphene {
 
                     item_id item_to_fetch(fetch_items_message_received.item_type, item_hash);
                     try {
-                        message requested_message = _delegate->get_item(item_to_fetch);
+                        auto requested_message = std::make_shared<const message>(_delegate->get_item(item_to_fetch));
                         dlog("received item request from peer ${endpoint}, returning the item from delegate with id ${id} size ${size}",
-                                ("id", requested_message.id())
-                                        ("size", requested_message.size)
+                                ("id", item_hash)
+                                        ("size", requested_message->size)
                                         ("endpoint", originating_peer->get_remote_endpoint()));
                         reply_messages.push_back(requested_message);
                         if (fetch_items_message_received.item_type ==
@@ -2869,7 +3287,7 @@ namespace graphene {
                         continue;
                     }
                     catch (fc::key_not_found_exception &) {
-                        reply_messages.push_back(item_not_available_message(item_to_fetch));
+                        reply_messages.push_back(std::make_shared<const message>(item_not_available_message(item_to_fetch)));
                         dlog("received item request from peer ${endpoint} but we don't have it",
                                 ("endpoint", originating_peer->get_remote_endpoint()));
                     }
@@ -2882,11 +3300,11 @@ namespace graphene {
                     originating_peer->last_block_time_delegate_has_seen = _delegate->get_block_time(block.block_id);
                 }
 
-                for (const message &reply : reply_messages) {
-                    if (reply.msg_type == block_message_type) {
-                        originating_peer->send_item(item_id(block_message_type, reply.as<graphene::network::block_message>().block_id));
+                for (shared_message_ptr &reply : reply_messages) {
+                    if (reply->msg_type == block_message_type) {
+                        originating_peer->send_item(item_id(block_message_type, reply->as<graphene::network::block_message>().block_id));
                     } else {
-                        originating_peer->send_message(reply);
+                        originating_peer->send_message(std::move(reply));
                     }
                 }
             }
@@ -2899,6 +3317,7 @@ namespace graphene {
                     originating_peer->items_requested_from_peer.end()) {
                     originating_peer->items_requested_from_peer.erase(regular_item_iter);
                     originating_peer->inventory_peer_advertised_to_us.erase(requested_item);
+                    originating_peer->compact_blocks_being_reconstructed.erase(requested_item.item_hash);
                     if (is_item_in_any_peers_inventory(requested_item)) {
                         _items_to_fetch.insert(prioritized_item_id(requested_item, _items_to_fetch_sequence_counter++));
                     }
@@ -2912,6 +3331,18 @@ namespace graphene {
                     originating_peer->sync_items_requested_from_peer.end()) {
                     originating_peer->sync_items_requested_from_peer.erase(sync_item_iter);
 
+                    if (originating_peer->sync_request_is_range &&
+                        originating_peer->sync_items_requested_from_peer.size() + 1 < originating_peer->sync_request_size) {
+                        // the peer served the beginning of the range, but not all of it, request the rest again
+                        dlog("Peer served only a part of the requested block range");
+                        _active_sync_requests.erase(requested_item.item_hash);
+                        if (originating_peer->sync_items_requested_from_peer.empty()) {
+                            originating_peer->sync_request_size = 0;
+                        }
+                        trigger_fetch_sync_items_loop();
+                        return;
+                    }
+
                     if (originating_peer->peer_needs_sync_items_from_us) {
                         originating_peer->inhibit_fetching_sync_blocks = true;
                     } else {
@@ -2927,6 +3358,319 @@ namespace graphene {
                 dlog("Peer doesn't have an item we're looking for, which is fine because we weren't looking for it");
             }
 
+            void node_impl::on_fetch_sync_block_range_message(peer_connection *originating_peer,
+                    const fetch_sync_block_range_message &fetch_sync_block_range_message_received) {
+                VERIFY_CORRECT_THREAD();
+                uint32_t count = std::min<uint32_t>(fetch_sync_block_range_message_received.count, GRAPHENE_NET_MAX_BLOCKS_PER_PEER_DURING_SYNCING);
+                dlog("received request for ${count} blocks starting with ${first} from peer ${endpoint}",
+                        ("count", count)("first", fetch_sync_block_range_message_received.first_block)
+                                ("endpoint", originating_peer->get_remote_endpoint()));
+
+                // the delegate reads the whole range at once, instead of one call per block
+                std::vector<message> blocks = _delegate->get_block_range(fetch_sync_block_range_message_received.first_block, count);
+                if (blocks.empty()) {
+                    originating_peer->send_message(item_not_available_message(item_id(block_message_type, fetch_sync_block_range_message_received.first_block)));
+                    return;
+                }
+
+                graphene::network::block_message last_block = blocks.back().as<graphene::network::block_message>();
+                originating_peer->last_block_delegate_has_seen = last_block.block_id;
+                originating_peer->last_block_time_delegate_has_seen = last_block.block.timestamp;
+
+                for (const message &block : blocks) {
+                    originating_peer->send_message(block);
+                }
+
+                // tell about the blocks we won't send, so the peer requests them again without waiting for a timeout
+                if (fetch_sync_block_range_message_received.count > blocks.size()) {
+                    // the peer can't know more ids than one inventory holds
+                    uint32_t unsent_count = std::min<uint32_t>(fetch_sync_block_range_message_received.count - (uint32_t)blocks.size(), 2000);
+                    uint32_t remaining_item_count = 0;
+                    std::vector<item_hash_t> unsent_blocks = _delegate->get_block_ids(std::vector<item_hash_t>{last_block.block_id},
+                            remaining_item_count, unsent_count + 1);
+                    for (const item_hash_t &block_id : unsent_blocks) {
+                        if (block_id != last_block.block_id) {
+                            originating_peer->send_message(item_not_available_message(item_id(block_message_type, block_id)));
+                        }
+                    }
+                }
+            }
+
+            void node_impl::on_trx_reconciliation_request_message(peer_connection *originating_peer,
+                    const trx_reconciliation_request_message &trx_reconciliation_request_message_received) {
+                VERIFY_CORRECT_THREAD();
+                if (!originating_peer->supports_trx_reconciliation) {
+                    return;
+                }
+                // the peer abandoned the previous round, don't make its transactions wait for the next one
+                if (!originating_peer->trx_reconciliation_set_sent.empty()) {
+                    std::vector<item_hash_t> trx_message_ids;
+                    for (const auto &short_id_and_hash : originating_peer->trx_reconciliation_set_sent) {
+                        trx_message_ids.push_back(short_id_and_hash.second);
+                    }
+                    originating_peer->trx_reconciliation_set_sent.clear();
+                    advertise_reconciled_transactions(originating_peer, trx_message_ids);
+                }
+
+                // expect the difference of the sizes plus the share of the smaller set which differed the last time
+                uint32_t set_size = (uint32_t)originating_peer->trx_reconciliation_set.size();
+                uint32_t their_set_size = std::min<uint32_t>(trx_reconciliation_request_message_received.set_size,
+                        2 * GRAPHENE_NET_MAX_TRX_RECONCILIATION_SET_SIZE);
+                uint32_t smaller_set_size = std::min(set_size, their_set_size);
+                uint32_t capacity = std::max(set_size, their_set_size) - smaller_set_size +
+                                    smaller_set_size * trx_reconciliation_request_message_received.q_per_mille / 1000 + 1;
+                capacity = std::min<uint32_t>(capacity, 2 * GRAPHENE_NET_MAX_TRX_RECONCILIATION_SET_SIZE);
+
+                trx_reconciliation_sketch sketch(capacity);
+                for (const auto &short_id_and_hash : originating_peer->trx_reconciliation_set) {
+                    sketch.add(short_id_and_hash.first);
+                }
+                dlog("sending sketch of ${cells} cells for ${count} transaction(s) to peer ${endpoint}",
+                        ("cells", sketch.size())("count", set_size)("endpoint", originating_peer->get_remote_endpoint()));
+
+                // transactions coming from now on wait for the next round
+                originating_peer->trx_reconciliation_set_sent.swap(originating_peer->trx_reconciliation_set);
+                originating_peer->send_message(trx_reconciliation_sketch_message(set_size, sketch.release_cells()));
+            }
+
+            void node_impl::on_trx_reconciliation_sketch_message(peer_connection *originating_peer,
+                    const trx_reconciliation_sketch_message &trx_reconciliation_sketch_message_received) {
+                VERIFY_CORRECT_THREAD();
+                if (!originating_peer->trx_reconciliation_requested) {
+                    dlog("received a transaction reconciliation sketch I didn't ask for from peer ${endpoint}, ignoring it",
+                            ("endpoint", originating_peer->get_remote_endpoint()));
+                    return;
+                }
+                originating_peer->trx_reconciliation_requested = false;
+
+                fc::optional<trx_reconciliation_sketch> difference;
+                try {
+                    trx_reconciliation_sketch their_sketch(std::vector<trx_reconciliation_sketch_cell>(
+                            trx_reconciliation_sketch_message_received.sketch));
+                    difference = trx_reconciliation_sketch(std::vector<trx_reconciliation_sketch_cell>(their_sketch.size()));
+                    for (const auto &short_id_and_hash : originating_peer->trx_reconciliation_set) {
+                        difference->add(short_id_and_hash.first);
+                    }
+                    difference->subtract(their_sketch);
+                }
+                catch (const fc::exception &e) {
+                    wlog("received an invalid transaction reconciliation sketch from peer ${endpoint}, disconnecting from peer",
+                            ("endpoint", originating_peer->get_remote_endpoint()));
+                    disconnect_from_peer(originating_peer, "You sent me an invalid transaction reconciliation sketch", true, e);
+                    return;
+                }
+
+                std::unordered_map<uint32_t, item_hash_t> &set = originating_peer->trx_reconciliation_set;
+                std::vector<uint32_t> only_ours;
+                std::vector<uint32_t> only_theirs;
+                std::vector<item_hash_t> trx_message_ids_to_advertise;
+                bool success = difference->decode(only_ours, only_theirs);
+                if (success) {
+                    for (uint32_t short_id : only_ours) {
+                        auto itr = set.find(short_id);
+                        if (itr != set.end()) {
+                            trx_message_ids_to_advertise.push_back(itr->second);
+                        }
+                    }
+
+                    uint32_t their_set_size = trx_reconciliation_sketch_message_received.set_size;
+                    uint32_t smaller_set_size = std::min<uint32_t>((uint32_t)set.size(), their_set_size);
+                    uint32_t size_difference = std::max<uint32_t>((uint32_t)set.size(), their_set_size) - smaller_set_size;
+                    uint32_t difference_size = (uint32_t)(only_ours.size() + only_theirs.size());
+                    if (smaller_set_size) {
+                        originating_peer->trx_reconciliation_q_per_mille = (uint16_t)std::min<uint32_t>(2000,
+                                (difference_size > size_difference ? difference_size - size_difference : 0) * 1000 / smaller_set_size);
+                    }
+                    ++originating_peer->trx_reconciliations_succeeded;
+                } else {
+                    // the sets differ too much, fall back to advertising all of them
+                    for (const auto &short_id_and_hash : set) {
+                        trx_message_ids_to_advertise.push_back(short_id_and_hash.second);
+                    }
+                    only_theirs.clear();
+                    originating_peer->trx_reconciliation_q_per_mille = (uint16_t)std::min<uint32_t>(2000,
+                            originating_peer->trx_reconciliation_q_per_mille * 2 + 100);
+                    ++originating_peer->trx_reconciliations_failed;
+                }
+                dlog("reconciled transactions with peer ${endpoint}: success ${success}, ${ours} only ours, ${theirs} only theirs",
+                        ("endpoint", originating_peer->get_remote_endpoint())("success", success)
+                                ("ours", only_ours.size())("theirs", only_theirs.size()));
+
+                set.clear();
+                originating_peer->send_message(trx_reconciliation_result_message(success, std::move(only_theirs)));
+                advertise_reconciled_transactions(originating_peer, trx_message_ids_to_advertise);
+            }
+
+            void node_impl::on_trx_reconciliation_result_message(peer_connection *originating_peer,
+                    const trx_reconciliation_result_message &trx_reconciliation_result_message_received) {
+                VERIFY_CORRECT_THREAD();
+                std::unordered_map<uint32_t, item_hash_t> &set_sent = originating_peer->trx_reconciliation_set_sent;
+                std::vector<item_hash_t> trx_message_ids_to_advertise;
+                if (trx_reconciliation_result_message_received.success) {
+                    for (uint32_t short_id : trx_reconciliation_result_message_received.missing_ids) {
+                        auto itr = set_sent.find(short_id);
+                        if (itr != set_sent.end()) {
+                            trx_message_ids_to_advertise.push_back(itr->second);
+                        }
+                    }
+                    ++originating_peer->trx_reconciliations_succeeded;
+                } else {
+                    for (const auto &short_id_and_hash : set_sent) {
+                        trx_message_ids_to_advertise.push_back(short_id_and_hash.second);
+                    }
+                    ++originating_peer->trx_reconciliations_failed;
+                }
+
+                set_sent.clear();
+                advertise_reconciled_transactions(originating_peer, trx_message_ids_to_advertise);
+            }
+
+            void node_impl::send_compact_blocks(peer_connection *originating_peer, const std::vector<item_hash_t> &block_message_hashes) {
+                VERIFY_CORRECT_THREAD();
+                // blocks usually come from the message cache, older ones and the ones accepted during sync
+                // are read from the delegate, the same as for full blocks
+                for (const item_hash_t &block_message_hash : block_message_hashes) {
+                    item_id block_item(block_message_type, block_message_hash);
+                    shared_message_ptr requested_message = get_message_for_item(block_item);
+                    if (requested_message->msg_type != block_message_type) {
+                        dlog("received compact block request from peer ${endpoint} but we don't have it",
+                                ("endpoint", originating_peer->get_remote_endpoint()));
+                        originating_peer->send_message(requested_message);
+                        continue;
+                    }
+
+                    graphene::network::block_message block = requested_message->as<graphene::network::block_message>();
+                    originating_peer->last_block_delegate_has_seen = block.block_id;
+                    originating_peer->last_block_time_delegate_has_seen = block.block.timestamp;
+                    originating_peer->send_message(compact_block_message(block_message_hash, block));
+                }
+            }
+
+            void node_impl::on_compact_block_message(peer_connection *originating_peer, const compact_block_message &compact_block_message_received) {
+                VERIFY_CORRECT_THREAD();
+                const item_hash_t &block_message_hash = compact_block_message_received.block_message_hash;
+                if (originating_peer->items_requested_from_peer.find(item_id(block_message_type, block_message_hash)) ==
+                    originating_peer->items_requested_from_peer.end()) {
+                    wlog("received a compact block ${block_id} I didn't ask for from peer ${endpoint}, disconnecting from peer",
+                            ("endpoint", originating_peer->get_remote_endpoint())
+                                    ("block_id", compact_block_message_received.block_id));
+                    fc::exception detailed_error(FC_LOG_MESSAGE(error, "You sent me a block that I didn't ask for, block_id: ${block_id}",
+                            ("block_id", compact_block_message_received.block_id)));
+                    disconnect_from_peer(originating_peer, "You sent me a block that I didn't ask for", true, detailed_error);
+                    return;
+                }
+
+                peer_connection::partial_compact_block compact_block_to_process;
+                compact_block_to_process.compact_block = compact_block_message_received;
+                compact_block_to_process.transactions.resize(compact_block_message_received.transaction_ids.size());
+
+                std::vector<uint32_t> missing_transaction_indexes;
+                for (uint32_t i = 0; i < compact_block_message_received.transaction_ids.size(); ++i) {
+                    shared_message_ptr transaction_message = _message_cache.get_transaction_message(compact_block_message_received.transaction_ids[i]);
+                    if (transaction_message) {
+                        compact_block_to_process.transactions[i] = transaction_message->as<trx_message>().trx;
+                    } else {
+                        missing_transaction_indexes.push_back(i);
+                    }
+                }
+
+                if (missing_transaction_indexes.empty()) {
+                    process_compact_block(originating_peer, compact_block_to_process);
+                    return;
+                }
+
+                dlog("compact block ${block_id} from peer ${endpoint} misses ${count} of ${total} transactions, fetching them",
+                        ("block_id", compact_block_message_received.block_id)
+                                ("endpoint", originating_peer->get_remote_endpoint())
+                                ("count", missing_transaction_indexes.size())
+                                ("total", compact_block_message_received.transaction_ids.size()));
+                originating_peer->compact_blocks_being_reconstructed[block_message_hash] = std::move(compact_block_to_process);
+                originating_peer->send_message(fetch_compact_block_transactions_message(block_message_hash, missing_transaction_indexes));
+            }
+
+            void node_impl::on_fetch_compact_block_transactions_message(peer_connection *originating_peer,
+                    const fetch_compact_block_transactions_message &fetch_compact_block_transactions_message_received) {
+                VERIFY_CORRECT_THREAD();
+                const item_hash_t &block_message_hash = fetch_compact_block_transactions_message_received.block_message_hash;
+                try {
+                    shared_message_ptr requested_message = _message_cache.get_message(block_message_hash);
+                    FC_ASSERT(requested_message->msg_type == block_message_type);
+                    graphene::network::block_message block = requested_message->as<graphene::network::block_message>();
+
+                    compact_block_transactions_message reply(block_message_hash);
+                    reply.transactions.reserve(fetch_compact_block_transactions_message_received.transaction_indexes.size());
+                    for (uint32_t index : fetch_compact_block_transactions_message_received.transaction_indexes) {
+                        FC_ASSERT(index < block.block.transactions.size(), "Requested transaction is out of the block",
+                                ("index", index)("block_id", block.block_id));
+                        reply.transactions.push_back(block.block.transactions[index]);
+                    }
+                    originating_peer->send_message(reply);
+                }
+                catch (fc::key_not_found_exception &) {
+                    originating_peer->send_message(item_not_available_message(item_id(block_message_type, block_message_hash)));
+                }
+            }
+
+            void node_impl::on_compact_block_transactions_message(peer_connection *originating_peer,
+                    const compact_block_transactions_message &compact_block_transactions_message_received) {
+                VERIFY_CORRECT_THREAD();
+                const item_hash_t &block_message_hash = compact_block_transactions_message_received.block_message_hash;
+                auto iter = originating_peer->compact_blocks_being_reconstructed.find(block_message_hash);
+                if (iter == originating_peer->compact_blocks_being_reconstructed.end()) {
+                    dlog("Peer sent transactions of a compact block we aren't reconstructing, ignoring them");
+                    return;
+                }
+                peer_connection::partial_compact_block compact_block_to_process = std::move(iter->second);
+                originating_peer->compact_blocks_being_reconstructed.erase(iter);
+
+                const auto &received_transactions = compact_block_transactions_message_received.transactions;
+                size_t next_received_transaction = 0;
+                for (auto &transaction : compact_block_to_process.transactions) {
+                    if (!transaction && next_received_transaction < received_transactions.size()) {
+                        transaction = received_transactions[next_received_transaction++];
+                    }
+                }
+                if (next_received_transaction != received_transactions.size() ||
+                    std::any_of(compact_block_to_process.transactions.begin(), compact_block_to_process.transactions.end(),
+                        [](const fc::optional<signed_transaction> &transaction) { return !transaction; })) {
+                    wlog("Peer ${endpoint} sent wrong transactions of compact block ${block_id}, fetching the full block",
+                            ("endpoint", originating_peer->get_remote_endpoint())
+                                    ("block_id", compact_block_to_process.compact_block.block_id));
+                    originating_peer->send_message(fetch_items_message(block_message_type, {block_message_hash}));
+                    return;
+                }
+
+                process_compact_block(originating_peer, compact_block_to_process);
+            }
+
+            void node_impl::process_compact_block(peer_connection *originating_peer,
+                    const peer_connection::partial_compact_block &compact_block_to_process) {
+                VERIFY_CORRECT_THREAD();
+                const compact_block_message &compact_block = compact_block_to_process.compact_block;
+
+                graphene::network::block_message block;
+                static_cast<graphene::protocol::signed_block_header &>(block.block) = compact_block.header;
+                block.block.transactions.reserve(compact_block_to_process.transactions.size());
+                for (const auto &transaction : compact_block_to_process.transactions) {
+                    block.block.transactions.push_back(*transaction);
+                }
+                block.block_id = compact_block.block_id;
+
+                message block_message_to_process(block);
+                message_hash_type message_hash = run_decode_task(block_message_to_process.size, [&]() {
+                    return block_message_to_process.id();
+                });
+                if (message_hash != compact_block.block_message_hash) {
+                    // a cached transaction has the same id as the one in the block, but differs in signatures
+                    dlog("compact block ${block_id} was rebuilt with different transactions, fetching the full block",
+                            ("block_id", compact_block.block_id));
+                    originating_peer->send_message(fetch_items_message(block_message_type, {compact_block.block_message_hash}));
+                    return;
+                }
+
+                process_block_message(originating_peer, block_message_to_process, message_hash);
+            }
+
             void node_impl::on_item_ids_inventory_message(peer_connection *originating_peer, const item_ids_inventory_message &item_ids_inventory_message_received) {
                 VERIFY_CORRECT_THREAD();
 
@@ -2936,6 +3680,19 @@ namespace graphene {
                 dlog("received inventory of ${count} items from peer ${endpoint}",
                         ("count", item_ids_inventory_message_received.item_hashes_available.size())("endpoint", originating_peer->get_remote_endpoint()));
                 for (const item_hash_t &item_hash : item_ids_inventory_message_received.item_hashes_available) {
+                    if (item_ids_inventory_message_received.item_type == block_message_type) {
+                        record_block_announcement(originating_peer, item_hash);
+                    }
+                    if (item_ids_inventory_message_received.item_type == trx_message_type &&
+                        !originating_peer->trx_reconciliation_set.empty()) {
+                        // the peer has the transaction, there is nothing to reconcile
+                        auto reconciliation_itr = originating_peer->trx_reconciliation_set.find(
+                                get_short_trx_id(originating_peer->trx_reconciliation_salt, item_hash));
+                        if (reconciliation_itr != originating_peer->trx_reconciliation_set.end() &&
+                            reconciliation_itr->second == item_hash) {
+                            originating_peer->trx_reconciliation_set.erase(reconciliation_itr);
+                        }
+                    }
                     if (_message_ids_currently_being_processed.find(item_hash) !=
                         _message_ids_currently_being_processed.end()) {
                             // we're in the middle of processing this item, no need to fetch it again
@@ -3330,55 +4087,83 @@ namespace graphene {
                 std::set<peer_connection_ptr> peers_we_need_to_sync_to;
                 std::map<peer_connection_ptr, fc::oexception> peers_with_rejected_block;
 
+                if (!_new_received_sync_items.empty()) {
+                    // let the client check the whole batch of just received blocks at once, instead of
+                    // doing it serially while pushing them.  This call yields, so work on a copy of headers
+                    std::vector<graphene::protocol::signed_block_header> headers_to_prevalidate;
+                    headers_to_prevalidate.reserve(_new_received_sync_items.size());
+                    for (const graphene::network::block_message &received_block : _new_received_sync_items) {
+                        headers_to_prevalidate.push_back(received_block.block);
+                    }
+                    try {
+                        _delegate->prevalidate_sync_blocks(headers_to_prevalidate);
+                    }
+                    catch (const fc::canceled_exception &) {
+                        throw;
+                    }
+                    catch (const fc::exception &e) {
+                        wlog("Failed to prevalidate ${count} sync blocks: ${e}",
+                                ("count", headers_to_prevalidate.size())("e", e));
+                    }
+                }
+
                 do {
-                    std::copy(std::make_move_iterator(_new_received_sync_items.begin()),
-                            std::make_move_iterator(_new_received_sync_items.end()),
-                            std::front_inserter(_received_sync_items));
+                    for (graphene::network::block_message &received_block : _new_received_sync_items) {
+                        _received_sync_items.insert(received_sync_block(std::move(received_block)));
+                    }
                     _new_received_sync_items.clear();
                     dlog("currently ${count} sync items to consider", ("count", _received_sync_items.size()));
 
                     block_processed_this_iteration = false;
-                    for (auto received_block_iter = _received_sync_items.begin();
-                         received_block_iter != _received_sync_items.end();
-                         ++received_block_iter) {
 
-                        // find out if this block is the next block on the active chain or one of the forks
-                        bool potential_first_block = false;
+                    // the next block on the active chain or one of the forks is the one some peer expects next,
+                    // so look up the front of each peer's list instead of matching every received block.
+                    // Of several candidates the lowest block is pushed first
+                    auto &received_blocks_by_id = _received_sync_items.get<sync_block_id_index>();
+                    auto first_block_iter = received_blocks_by_id.end();
+                    for (const peer_connection_ptr &peer : _active_connections) {
+                        ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
+                        if (!peer->ids_of_items_to_get.empty()) {
+                            auto candidate_iter = received_blocks_by_id.find(peer->ids_of_items_to_get.front());
+                            if (candidate_iter != received_blocks_by_id.end() &&
+                                (first_block_iter == received_blocks_by_id.end() ||
+                                 candidate_iter->block_num < first_block_iter->block_num)) {
+                                first_block_iter = candidate_iter;
+                            }
+                        }
+                    }
+
+                    // if there is one, process it, remove it from all sync peers lists
+                    if (first_block_iter != received_blocks_by_id.end()) {
+                        const item_hash_t block_id = first_block_iter->block_id;
                         for (const peer_connection_ptr &peer : _active_connections) {
                             ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
                             if (!peer->ids_of_items_to_get.empty() &&
-                                peer->ids_of_items_to_get.front() ==
-                                received_block_iter->block_id) {
-                                potential_first_block = true;
+                                peer->ids_of_items_to_get.front() == block_id) {
                                 peer->ids_of_items_to_get.pop_front();
-                                peer->ids_of_items_being_processed.insert(received_block_iter->block_id);
+                                peer->ids_of_items_being_processed.insert(block_id);
                             }
                         }
 
-                        // if it is, process it, remove it from all sync peers lists
-                        if (potential_first_block) {
-                            // we can get into an interesting situation near the end of synchronization.  We can be in
-                            // sync with one peer who is sending us the last block on the chain via a regular inventory
-                            // message, while at the same time still be synchronizing with a peer who is sending us the
-                            // block through the sync mechanism.  Further, we must request both blocks because
-                            // we don't know they're the same (for the peer in normal operation, it has only told us the
-                            // message id, for the peer in the sync case we only known the block_id).
-                            if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
-                                    received_block_iter->block_id) ==
-                                _most_recent_blocks_accepted.end()) {
-                                graphene::network::block_message block_message_to_process = *received_block_iter;
-                                _received_sync_items.erase(received_block_iter);
-                                _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process]() {
-                                    send_sync_block_to_node_delegate(block_message_to_process);
-                                }, "send_sync_block_to_node_delegate"));
-                                ++blocks_processed;
-                                block_processed_this_iteration = true;
-                            } else
-                                dlog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
-
-                            break; // start iterating _received_sync_items from the beginning
-                        } // end if potential_first_block
-                    } // end for each block in _received_sync_items
+                        // we can get into an interesting situation near the end of synchronization.  We can be in
+                        // sync with one peer who is sending us the last block on the chain via a regular inventory
+                        // message, while at the same time still be synchronizing with a peer who is sending us the
+                        // block through the sync mechanism.  Further, we must request both blocks because
+                        // we don't know they're the same (for the peer in normal operation, it has only told us the
+                        // message id, for the peer in the sync case we only known the block_id).
+                        if (!_most_recent_blocks_accepted.contains(block_id)) {
+                            graphene::network::block_message block_message_to_process = first_block_iter->block;
+                            received_blocks_by_id.erase(first_block_iter);
+                            _handle_message_calls_in_progress.emplace_back(fc::async([this, block_message_to_process]() {
+                                send_sync_block_to_node_delegate(block_message_to_process);
+                            }, "send_sync_block_to_node_delegate"));
+                            ++blocks_processed;
+                        } else {
+                            dlog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
+                            received_blocks_by_id.erase(first_block_iter);
+                        }
+                        block_processed_this_iteration = true;
+                    }
 
                     if (_handle_message_calls_in_progress.size() >=
                         _maximum_number_of_blocks_to_handle_at_one_time) {
@@ -3420,6 +4205,34 @@ namespace graphene {
                 trigger_process_backlog_of_sync_blocks();
             }
 
+            void node_impl::relay_block(peer_connection *originating_peer, const graphene::network::block_message &block_message_to_relay,
+                    const message_hash_type &message_hash, fc::time_point message_receive_time, fc::time_point message_validated_time) {
+                VERIFY_CORRECT_THREAD();
+                item_id block_message_item_id(core_message_type_enum::block_message_type, message_hash);
+                fc::time_point_sec block_time = block_message_to_relay.block.timestamp;
+
+                for (const peer_connection_ptr &peer : _active_connections) {
+                    ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
+
+                    auto iter = peer->inventory_peer_advertised_to_us.find(block_message_item_id);
+                    if (iter !=
+                        peer->inventory_peer_advertised_to_us.end()) {
+                        // this peer offered us the item.  It will eventually expire from the peer's
+                        // inventory_peer_advertised_to_us list after some time has passed (currently 2 minutes).
+                        // For now, it will remain there, which will prevent us from offering the peer this
+                        // block back when we rebroadcast the block below
+                        peer->last_block_delegate_has_seen = block_message_to_relay.block_id;
+                        peer->last_block_time_delegate_has_seen = block_time;
+                    }
+                    peer->clear_old_inventory();
+                }
+                message_propagation_data propagation_data{
+                        message_receive_time, message_validated_time,
+                        originating_peer->node_id
+                };
+                broadcast(block_message_to_relay, propagation_data);
+            }
+
             void node_impl::process_block_during_normal_operation(peer_connection *originating_peer,
                     const graphene::network::block_message &block_message_to_process,
                     const message_hash_type &message_hash) {
@@ -3430,6 +4243,7 @@ namespace graphene {
                 std::string disconnect_reason;
                 fc::oexception disconnect_exception;
                 fc::oexception restart_sync_exception;
+                bool relayed_before_apply = false;
                 try {
                     // we can get into an intersting situation near the end of synchronization.  We can be in
                     // sync with one peer who is sending us the last block on the chain via a regular inventory
@@ -3438,9 +4252,25 @@ namespace graphene {
                     // we don't know they're the same (for the peer in normal operation, it has only told us the
                     // message id, for the peer in the sync case we only known the block_id).
                     fc::time_point message_validated_time;
-                    if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
-                            block_message_to_process.block_id) ==
-                        _most_recent_blocks_accepted.end()) {
+                    if (!_most_recent_blocks_accepted.contains(block_message_to_process.block_id)) {
+                        if (_header_first_relay) {
+                            // don't make every hop wait for the block to be applied, the peer is
+                            // disconnected below as usual if applying fails
+                            try {
+                                _delegate->prevalidate_block_for_relay(block_message_to_process);
+                                relay_block(originating_peer, block_message_to_process, message_hash,
+                                        message_receive_time, fc::time_point::now());
+                                relayed_before_apply = true;
+                            }
+                            catch (const fc::canceled_exception &) {
+                                throw;
+                            }
+                            catch (const fc::exception &e) {
+                                dlog("not relaying block ${num} before applying it: ${e}",
+                                        ("num", block_message_to_process.block.block_num())("e", e.to_string()));
+                            }
+                        }
+
                         std::vector<fc::uint160_t> contained_transaction_message_ids;
                         _message_ids_currently_being_processed.insert(message_hash);
                         fc_ilog(fc::logger::get("sync"),
@@ -3482,34 +4312,14 @@ namespace graphene {
                         dlog("Already received and accepted this block (presumably through sync mechanism), treating it as accepted");
                     }
 
-                    dlog("client validated the block, advertising it to other peers");
-
-                    item_id block_message_item_id(core_message_type_enum::block_message_type, message_hash);
-                    uint32_t block_number = block_message_to_process.block.block_num();
-                    fc::time_point_sec block_time = block_message_to_process.block.timestamp;
-
-                    for (const peer_connection_ptr &peer : _active_connections) {
-                        ASSERT_TASK_NOT_PREEMPTED(); // don't yield while iterating over _active_connections
-
-                        auto iter = peer->inventory_peer_advertised_to_us.find(block_message_item_id);
-                        if (iter !=
-                            peer->inventory_peer_advertised_to_us.end()) {
-                            // this peer offered us the item.  It will eventually expire from the peer's
-                            // inventory_peer_advertised_to_us list after some time has passed (currently 2 minutes).
-                            // For now, it will remain there, which will prevent us from offering the peer this
-                            // block back when we rebroadcast the block below
-                            peer->last_block_delegate_has_seen = block_message_to_process.block_id;
-                            peer->last_block_time_delegate_has_seen = block_time;
-                        }
-                        peer->clear_old_inventory();
+                    if (!relayed_before_apply) {
+                        dlog("client validated the block, advertising it to other peers");
+                        relay_block(originating_peer, block_message_to_process, message_hash,
+                                message_receive_time, message_validated_time);
                     }
-                    message_propagation_data propagation_data{
-                            message_receive_time, message_validated_time,
-                            originating_peer->node_id
-                    };
-                    broadcast(block_message_to_process, propagation_data);
                     _message_cache.block_accepted();
 
+                    uint32_t block_number = block_message_to_process.block.block_num();
                     if (is_hard_fork_block(block_number)) {
                         // we just pushed a hard fork block.  Find out if any of our peers are running clients
                         // that will be unable to process future blocks
@@ -3551,12 +4361,52 @@ namespace graphene {
                     disconnect_exception = e;
                     disconnect_reason = "You offered me a block that I have deemed to be invalid";
 
-                    peers_to_disconnect.insert(originating_peer->shared_from_this());
+                    if (relayed_before_apply) {
+                        // don't serve or advertise it anymore, and push it again if it comes from another peer
+                        _message_cache.erase_message(message_hash);
+                        _new_inventory.erase(item_id(block_message_type, message_hash));
+                        _most_recent_blocks_accepted.erase(block_message_to_process.block_id);
+                    }
+
+                    // a peer relaying blocks before applying them can't know that the contents of a block
+                    // with a valid header are invalid, only the producer of the block is at fault
+                    fc::optional<bool> passed_header_check;
+                    if (relayed_before_apply) {
+                        passed_header_check = true;
+                    }
+                    auto is_at_fault = [&](const peer_connection_ptr &peer) {
+                        if (!peer->relays_header_first) {
+                            return true;
+                        }
+                        if (!passed_header_check) {
+                            try {
+                                _delegate->prevalidate_block_for_relay(block_message_to_process);
+                                passed_header_check = true;
+                            }
+                            catch (const fc::canceled_exception &) {
+                                throw;
+                            }
+                            catch (const fc::exception &) {
+                                passed_header_check = false;
+                            }
+                        }
+                        return !*passed_header_check;
+                    };
+
+                    std::vector<peer_connection_ptr> peers_offering_block{originating_peer->shared_from_this()};
                     for (const peer_connection_ptr &peer : _active_connections) {
                         if (!peer->ids_of_items_to_get.empty() &&
                             peer->ids_of_items_to_get.front() ==
                             block_message_to_process.block_id) {
+                            peers_offering_block.push_back(peer);
+                        }
+                    }
+                    for (const peer_connection_ptr &peer : peers_offering_block) {
+                        if (is_at_fault(peer)) {
                             peers_to_disconnect.insert(peer);
+                        } else {
+                            dlog("not disconnecting ${endpoint}, it relayed the block before applying it",
+                                    ("endpoint", peer->get_remote_endpoint()));
                         }
                     }
                 }
@@ -3583,7 +4433,9 @@ namespace graphene {
                 // (it's possible that we request an item during normal operation and then get kicked into sync
                 // mode before we receive and process the item.  In that case, we should process the item as a normal
                 // item to avoid confusing the sync code)
-                graphene::network::block_message block_message_to_process(message_to_process.as<graphene::network::block_message>());
+                graphene::network::block_message block_message_to_process(run_decode_task(message_to_process.size, [&]() {
+                    return message_to_process.as<graphene::network::block_message>();
+                }));
                 auto item_iter = originating_peer->items_requested_from_peer.find(item_id(graphene::network::block_message_type, message_hash));
                 if (item_iter !=
                     originating_peer->items_requested_from_peer.end()) {
@@ -3601,6 +4453,20 @@ namespace graphene {
                         originating_peer->sync_items_requested_from_peer.erase(sync_item_iter);
                         originating_peer->last_sync_item_received_time = fc::time_point::now();
                         _active_sync_requests.erase(block_message_to_process.block_id);
+                        if (originating_peer->sync_items_requested_from_peer.empty() &&
+                            originating_peer->sync_request_size != 0) {
+                            // the whole batch arrived, update the moving average of the rate this peer delivers blocks with
+                            int64_t elapsed_us = std::max<int64_t>(
+                                    (originating_peer->last_sync_item_received_time - originating_peer->sync_request_sent_time).count(), 1);
+                            uint32_t batch_rate = (uint32_t)std::min<uint64_t>(
+                                    uint64_t(originating_peer->sync_request_size) * 1000000 / elapsed_us, std::numeric_limits<uint32_t>::max());
+                            originating_peer->sync_block_rate = originating_peer->sync_block_rate == 0 ? batch_rate :
+                                    (uint32_t)((uint64_t(originating_peer->sync_block_rate) * 3 + batch_rate) / 4);
+                            originating_peer->sync_request_size = 0;
+                            update_peer_record(originating_peer, [&](potential_peer_record &record) {
+                                record.sync_block_rate = originating_peer->sync_block_rate;
+                            });
+                        }
                         process_block_during_sync(originating_peer, block_message_to_process, message_hash);
                         if (originating_peer->idle()) {
                             // we have finished fetching a batch of items, so we either need to grab another batch of items
@@ -3653,6 +4519,9 @@ namespace graphene {
                                                       current_time_reply_message_received.request_sent_time) -
                                                      (current_time_reply_message_received.reply_transmitted_time -
                                                       current_time_reply_message_received.request_received_time);
+                update_peer_record(originating_peer, [&](potential_peer_record &record) {
+                    record.record_round_trip_delay(originating_peer->round_trip_delay);
+                });
             }
 
             void node_impl::forward_firewall_check_to_next_available_peer(firewall_check_state_data *firewall_check_state) {
@@ -3927,7 +4796,9 @@ namespace graphene {
                     fc::time_point message_validated_time;
                     try {
                         if (message_to_process.msg_type == trx_message_type) {
-                            trx_message transaction_message_to_process = message_to_process.as<trx_message>();
+                            trx_message transaction_message_to_process = run_decode_task(message_to_process.size, [&]() {
+                                return message_to_process.as<trx_message>();
+                            });
                             dlog("passing message containing transaction ${trx} to client", ("trx", transaction_message_to_process.trx.id()));
                             _delegate->handle_transaction(transaction_message_to_process);
                         } else {
@@ -4128,6 +4999,17 @@ namespace graphene {
                     wlog("Exception thrown while terminating Advertise inventory loop, ignoring");
                 }
 
+                try {
+                    _trx_reconciliation_loop_done.cancel_and_wait("node_impl::close()");
+                    dlog("Transaction reconciliation loop terminated");
+                }
+                catch (const fc::exception &e) {
+                    wlog("Exception thrown while terminating Transaction reconciliation loop, ignoring: ${e}", ("e", e));
+                }
+                catch (...) {
+                    wlog("Exception thrown while terminating Transaction reconciliation loop, ignoring");
+                }
+
 
                 // Next, terminate our existing connections.  First, close all of the connections nicely.
                 // This will close the sockets and may result in calls to our "on_connection_closing"
@@ -4465,7 +5347,15 @@ namespace graphene {
                 fc::path potential_peer_database_file_name(
                         _node_configuration_directory /
                         POTENTIAL_PEER_DATABASE_FILENAME);
+                fc::path legacy_potential_peer_database_file_name(
+                        _node_configuration_directory /
+                        LEGACY_POTENTIAL_PEER_DATABASE_FILENAME);
                 try {
+                    if (!fc::exists(potential_peer_database_file_name) &&
+                        fc::exists(legacy_potential_peer_database_file_name)) {
+                        // the database reads the JSON of older versions and saves it in its binary format
+                        fc::rename(legacy_potential_peer_database_file_name, potential_peer_database_file_name);
+                    }
                     _potential_peer_db.open(potential_peer_database_file_name);
 
                     // push back the time on all peers loaded from the database so we will be able to retry them immediately
@@ -4589,7 +5479,8 @@ namespace graphene {
                        !_terminate_inactive_connections_loop_done.valid() &&
                        !_fetch_updated_peer_lists_loop_done.valid() &&
                        !_bandwidth_monitor_loop_done.valid() &&
-                       !_dump_node_status_task_done.valid());
+                       !_dump_node_status_task_done.valid() &&
+                       !_trx_reconciliation_loop_done.valid());
                 if (_node_configuration.accept_incoming_connections) {
                     _accept_loop_complete = fc::async([=]() { accept_loop(); }, "accept_loop");
                 }
@@ -4601,6 +5492,7 @@ namespace graphene {
                 _fetch_updated_peer_lists_loop_done = fc::async([=]() { fetch_updated_peer_lists_loop(); }, "fetch_updated_peer_lists_loop");
                 _bandwidth_monitor_loop_done = fc::async([=]() { bandwidth_monitor_loop(); }, "bandwidth_monitor_loop");
                 _dump_node_status_task_done = fc::async([=]() { dump_node_status_task(); }, "dump_node_status_task");
+                _trx_reconciliation_loop_done = fc::async([=]() { trx_reconciliation_loop(); }, "trx_reconciliation_loop");
             }
 
             void node_impl::add_node(const fc::ip::endpoint &ep) {
@@ -4771,6 +5663,9 @@ namespace graphene {
                             } else {
                                 updated_peer_record->last_error = fc::exception(FC_LOG_MESSAGE(info, reason_for_disconnect.c_str()));
                             }
+                            if (caused_by_error) {
+                                ++updated_peer_record->number_of_misbehaviors;
+                            }
                             _potential_peer_db.update_entry(*updated_peer_record);
                         }
                     }
@@ -4843,6 +5738,15 @@ namespace graphene {
                     peer_details["lastrecv"] = peer->get_last_message_received_time().sec_since_epoch();
                     peer_details["bytessent"] = peer->get_total_bytes_sent();
                     peer_details["bytesrecv"] = peer->get_total_bytes_received();
+                    peer_details["send_queues"] = peer->get_send_queue_status();
+                    if (peer->supports_trx_reconciliation) {
+                        fc::mutable_variant_object trx_reconciliation;
+                        trx_reconciliation["set_size"] = peer->trx_reconciliation_set.size();
+                        trx_reconciliation["succeeded"] = peer->trx_reconciliations_succeeded;
+                        trx_reconciliation["failed"] = peer->trx_reconciliations_failed;
+                        trx_reconciliation["q_per_mille"] = peer->trx_reconciliation_q_per_mille;
+                        peer_details["trx_reconciliation"] = trx_reconciliation;
+                    }
                     peer_details["conntime"] = peer->get_connection_time();
                     peer_details["pingtime"] = "";
                     peer_details["pingwait"] = "";
@@ -4919,7 +5823,8 @@ namespace graphene {
                 }
                 message_hash_type hash_of_item_to_broadcast = item_to_broadcast.id();
 
-                _message_cache.cache_message(item_to_broadcast, hash_of_item_to_broadcast, propagation_data, hash_of_message_contents);
+                _message_cache.cache_message(std::make_shared<const message>(item_to_broadcast), hash_of_item_to_broadcast,
+                        propagation_data, hash_of_message_contents);
                 _new_inventory.insert(item_id(item_to_broadcast.msg_type, hash_of_item_to_broadcast));
                 trigger_advertise_inventory_loop();
             }
@@ -4978,6 +5883,9 @@ namespace graphene {
                 if (params.contains("maximum_blocks_per_peer_during_syncing")) {
                     _maximum_blocks_per_peer_during_syncing = params["maximum_blocks_per_peer_during_syncing"].as<uint32_t>();
                 }
+                if (params.contains("header_first_relay")) {
+                    _header_first_relay = params["header_first_relay"].as_bool();
+                }
 
                 _desired_number_of_connections = std::min(_desired_number_of_connections, _maximum_number_of_connections);
 
@@ -4998,6 +5906,7 @@ namespace graphene {
                 result["maximum_number_of_blocks_to_handle_at_one_time"] = _maximum_number_of_blocks_to_handle_at_one_time;
                 result["maximum_number_of_sync_blocks_to_prefetch"] = _maximum_number_of_sync_blocks_to_prefetch;
                 result["maximum_blocks_per_peer_during_syncing"] = _maximum_blocks_per_peer_during_syncing;
+                result["header_first_relay"] = _header_first_relay;
                 return result;
             }
 
@@ -5248,9 +6157,15 @@ namespace graphene {
         }
 
         struct simulated_network::node_info {
+            struct message_in_transit {
+                message message_to_deliver;
+                fc::time_point delivery_time;
+            };
+
             node_delegate *delegate;
             fc::future<void> message_sender_task_done;
-            std::queue<message> messages_to_deliver;
+            std::queue<message_in_transit> messages_to_deliver;
+            fc::time_point link_free_time; // when the link finishes transmitting the messages already sent over it
 
             node_info(node_delegate *delegate) : delegate(delegate) {
             }
@@ -5266,7 +6181,11 @@ namespace graphene {
         void simulated_network::message_sender(node_info *destination_node) {
             while (!destination_node->messages_to_deliver.empty()) {
                 try {
-                    const message &message_to_deliver = destination_node->messages_to_deliver.front();
+                    fc::time_point delivery_time = destination_node->messages_to_deliver.front().delivery_time;
+                    if (delivery_time > fc::time_point::now()) {
+                        fc::usleep(delivery_time - fc::time_point::now());
+                    }
+                    const message &message_to_deliver = destination_node->messages_to_deliver.front().message_to_deliver;
                     if (message_to_deliver.msg_type == trx_message_type) {
                         destination_node->delegate->handle_transaction(message_to_deliver.as<trx_message>());
                     } else if (message_to_deliver.msg_type ==
@@ -5277,6 +6196,9 @@ namespace graphene {
                         destination_node->delegate->handle_message(message_to_deliver);
                     }
                 }
+                catch (const fc::canceled_exception &) {
+                    throw;
+                }
                 catch (const fc::exception &e) {
                     elog("${r}", ("r", e));
                 }
@@ -5285,8 +6207,21 @@ namespace graphene {
         }
 
         void simulated_network::broadcast(const message &item_to_broadcast) {
+            fc::time_point now = fc::time_point::now();
             for (node_info *network_node_info : network_nodes) {
-                network_node_info->messages_to_deliver.emplace(item_to_broadcast);
+                // the message takes the link until it's transmitted, even if it's lost on the way
+                fc::time_point transmission_start = std::max(now, network_node_info->link_free_time);
+                fc::microseconds transmission_time;
+                if (link_bandwidth) {
+                    transmission_time = fc::microseconds(uint64_t(item_to_broadcast.size) * 1000000 / link_bandwidth);
+                }
+                network_node_info->link_free_time = transmission_start + transmission_time;
+                if (link_loss_probability > 0 &&
+                    std::uniform_real_distribution<double>(0, 1)(link_random_engine) < link_loss_probability) {
+                    continue;
+                }
+
+                network_node_info->messages_to_deliver.push({item_to_broadcast, network_node_info->link_free_time + link_latency});
                 if (!network_node_info->message_sender_task_done.valid() ||
                     network_node_info->message_sender_task_done.ready()) {
                         network_node_info->message_sender_task_done = fc::async([=]() { message_sender(network_node_info); }, "simulated_network_sender");
@@ -5298,6 +6233,13 @@ namespace graphene {
             network_nodes.push_back(new node_info(node_delegate_to_add));
         }
 
+        void simulated_network::set_link_properties(fc::microseconds latency, uint32_t bandwidth_bytes_per_second,
+                double loss_probability) {
+            link_latency = latency;
+            link_bandwidth = bandwidth_bytes_per_second;
+            link_loss_probability = loss_probability;
+        }
+
         namespace detail {
 #define ROLLING_WINDOW_SIZE 1000
 #define INITIALIZE_ACCUMULATOR(r, data, method_name) \
@@ -5412,6 +6354,14 @@ namespace graphene {
                 INVOKE_AND_COLLECT_STATISTICS(handle_block, block_message, sync_mode, contained_transaction_message_ids);
             }
 
+            void statistics_gathering_node_delegate_wrapper::prevalidate_sync_blocks(const std::vector<graphene::protocol::signed_block_header> &headers) {
+                INVOKE_AND_COLLECT_STATISTICS(prevalidate_sync_blocks, headers);
+            }
+
+            void statistics_gathering_node_delegate_wrapper::prevalidate_block_for_relay(const graphene::network::block_message &block_message) {
+                INVOKE_AND_COLLECT_STATISTICS(prevalidate_block_for_relay, block_message);
+            }
+
             void statistics_gathering_node_delegate_wrapper::handle_transaction(const graphene::network::trx_message &transaction_message) {
                 INVOKE_AND_COLLECT_STATISTICS(handle_transaction, transaction_message);
             }
@@ -5426,6 +6376,10 @@ namespace graphene {
                 INVOKE_AND_COLLECT_STATISTICS(get_item, id);
             }
 
+            std::vector<message> statistics_gathering_node_delegate_wrapper::get_block_range(const item_hash_t &first_block, uint32_t count) {
+                INVOKE_AND_COLLECT_STATISTICS(get_block_range, first_block, count);
+            }
+
             std::vector<item_hash_t> statistics_gathering_node_delegate_wrapper::get_blockchain_synopsis(const item_hash_t &reference_point, uint32_t number_of_blocks_after_reference_point) {
                 INVOKE_AND_COLLECT_STATISTICS(get_blockchain_synopsis, reference_point, number_of_blocks_after_reference_point);
             }
@@ -22,6 +22,7 @@
  * THE SOFTWARE.
  */
 #include <graphene/network/peer_connection.hpp>
+#include <graphene/network/message_compression.hpp>
 
 #include <fc/thread/thread.hpp>
 
@@ -38,26 +39,29 @@
 
 namespace graphene {
     namespace network {
-        message peer_connection::real_queued_message::get_message(peer_connection_delegate *) {
+        shared_message_ptr peer_connection::real_queued_message::get_message(peer_connection_delegate *) {
             if (message_send_time_field_offset != (size_t)-1) {
                 // patch the current time into the message.  Since this operates on the packed version of the structure,
-                // it won't work for anything after a variable-length field
+                // it won't work for anything after a variable-length field.  Only small messages with a time field
+                // are sent this way, so patching a copy leaves the shared one alone
                 std::vector<char> packed_current_time = fc::raw::pack(fc::time_point::now());
                 assert(message_send_time_field_offset +
                        packed_current_time.size() <=
-                       message_to_send.data.size());
-                memcpy(message_to_send.data.data() +
+                       message_to_send->data.size());
+                auto patched_message = std::make_shared<message>(*message_to_send);
+                memcpy(patched_message->data.data() +
                        message_send_time_field_offset,
                         packed_current_time.data(), packed_current_time.size());
+                return patched_message;
             }
             return message_to_send;
         }
 
         size_t peer_connection::real_queued_message::get_size_in_queue() {
-            return message_to_send.data.size();
+            return message_to_send->data.size();
         }
 
-        message peer_connection::virtual_queued_message::get_message(peer_connection_delegate *node) {
+        shared_message_ptr peer_connection::virtual_queued_message::get_message(peer_connection_delegate *node) {
             return node->get_message_for_item(item_to_send);
         }
 
@@ -65,10 +69,26 @@ namespace graphene {
             return sizeof(item_id);
         }
 
+        peer_connection::send_queue_class peer_connection::get_send_queue_class(uint32_t msg_type) {
+            switch (msg_type) {
+                case core_message_type_enum::trx_message_type:
+                    return send_queue_class::transactions;
+                case core_message_type_enum::address_request_message_type:
+                case core_message_type_enum::address_message_type:
+                case core_message_type_enum::get_current_connections_request_message_type:
+                case core_message_type_enum::get_current_connections_reply_message_type:
+                    return send_queue_class::gossip;
+                default:
+                    return send_queue_class::blocks;
+            }
+        }
+
         peer_connection::peer_connection(peer_connection_delegate *delegate) :
                 _node(delegate),
                 _message_connection(this),
                 _total_queued_messages_size(0),
+                _transactions_sent_in_a_row(0),
+                _message_being_sent(nullptr),
                 direction(peer_connection_direction::unknown),
                 is_firewalled(firewalled_state::unknown),
                 our_state(our_connection_state::disconnected),
@@ -79,7 +99,20 @@ namespace graphene {
                 number_of_unfetched_item_ids(0),
                 peer_needs_sync_items_from_us(true),
                 we_need_sync_items_from_peer(true),
+                supports_block_ranges(false),
+                sync_block_rate(0),
+                sync_request_size(0),
+                sync_request_is_range(false),
                 inhibit_fetching_sync_blocks(false),
+                supports_compact_blocks(false),
+                supports_compression(false),
+                relays_header_first(false),
+                supports_trx_reconciliation(false),
+                trx_reconciliation_salt(0),
+                trx_reconciliation_requested(false),
+                trx_reconciliation_q_per_mille(100),
+                trx_reconciliations_succeeded(0),
+                trx_reconciliations_failed(0),
                 transaction_fetching_inhibited_until(fc::time_point::min()),
                 last_known_fork_block_number(0),
                 firewall_check_state(nullptr)
@@ -243,6 +276,13 @@ namespace graphene {
 
         void peer_connection::on_message(message_oriented_connection *originating_connection, const message &received_message) {
             VERIFY_CORRECT_THREAD();
+            if (received_message.msg_type == core_message_type_enum::compressed_message_type) {
+                // the node sees the original message, its hash is the hash of the uncompressed body
+                _node->on_message(this, run_decode_task(received_message.size, [&]() {
+                    return decompress_message(received_message);
+                }));
+                return;
+            }
             _node->on_message(this, received_message);
         }
 
@@ -269,23 +309,35 @@ namespace graphene {
                     --_send_message_queue_tasks_counter; /* dlog("leaving peer_connection::send_queued_messages_task()"); */ }
             } concurrent_invocation_counter(_send_message_queue_tasks_running);
 #endif
-            while (!_queued_messages.empty()) {
-                _queued_messages.front()->transmission_start_time = fc::time_point::now();
-                message message_to_send = _queued_messages.front()->get_message(_node);
+            while (send_queue *queue = get_next_send_queue()) {
+                queued_message &message_to_queue = *queue->messages.front();
+                _message_being_sent = &message_to_queue;
+                message_to_queue.transmission_start_time = fc::time_point::now();
+                queue->average_latency = fc::microseconds((queue->average_latency.count() * 7 +
+                        (message_to_queue.transmission_start_time - message_to_queue.enqueue_time).count()) / 8);
+                shared_message_ptr message_to_send = message_to_queue.get_message(_node);
+                if (supports_compression && message_to_send->size >= GRAPHENE_NET_MIN_COMPRESSED_MESSAGE_SIZE) {
+                    shared_message_ptr compressed = _node->get_compressed_message(message_to_send).wait();
+                    if (compressed) {
+                        message_to_send = std::move(compressed);
+                    }
+                }
                 try {
                     //dlog("peer_connection::send_queued_messages_task() calling message_oriented_connection::send_message() "
                     //     "to send message of type ${type} for peer ${endpoint}",
                     //     ("type", message_to_send.msg_type)("endpoint", get_remote_endpoint()));
-                    _message_connection.send_message(message_to_send);
+                    _message_connection.send_message(*message_to_send);
                     //dlog("peer_connection::send_queued_messages_task()'s call to message_oriented_connection::send_message() completed normally for peer ${endpoint}",
                     //     ("endpoint", get_remote_endpoint()));
                 }
                 catch (const fc::canceled_exception &) {
                     dlog("message_oriented_connection::send_message() was canceled, rethrowing canceled_exception");
+                    _message_being_sent = nullptr;
                     throw;
                 }
                 catch (const fc::exception &send_error) {
                     elog("Error sending message: ${exception}.  Closing connection.", ("exception", send_error));
+                    _message_being_sent = nullptr;
                     try {
                         close_connection();
                     }
@@ -300,17 +352,76 @@ namespace graphene {
                 catch (...) {
                     elog("message_oriented_exception::send_message() threw an unhandled exception");
                 }
-                _queued_messages.front()->transmission_finish_time = fc::time_point::now();
-                _total_queued_messages_size -= _queued_messages.front()->get_size_in_queue();
-                _queued_messages.pop();
+                _message_being_sent = nullptr;
+                message_to_queue.transmission_finish_time = fc::time_point::now();
+                size_t size_in_queue = message_to_queue.get_size_in_queue();
+                _total_queued_messages_size -= size_in_queue;
+                queue->size_in_bytes -= size_in_queue;
+                ++queue->messages_sent;
+                queue->messages.pop_front();
             }
             //dlog("leaving peer_connection::send_queued_messages_task() due to queue exhaustion");
         }
 
+        peer_connection::send_queue *peer_connection::get_next_send_queue() {
+            send_queue &blocks = _send_queues[(unsigned)send_queue_class::blocks];
+            send_queue &transactions = _send_queues[(unsigned)send_queue_class::transactions];
+            send_queue &gossip = _send_queues[(unsigned)send_queue_class::gossip];
+            if (!blocks.messages.empty()) {
+                return &blocks;
+            }
+            // gossip still gets a turn now and then while transactions are flooding in
+            if (!transactions.messages.empty() &&
+                (gossip.messages.empty() || _transactions_sent_in_a_row < GRAPHENE_NET_TRANSACTIONS_PER_GOSSIP_MESSAGE)) {
+                ++_transactions_sent_in_a_row;
+                return &transactions;
+            }
+            if (!gossip.messages.empty()) {
+                _transactions_sent_in_a_row = 0;
+                return &gossip;
+            }
+            return nullptr;
+        }
+
+        void peer_connection::drop_gossip_messages() {
+            send_queue &gossip = _send_queues[(unsigned)send_queue_class::gossip];
+            // the newest go first, the front one may be on its way already
+            while (_total_queued_messages_size > GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES &&
+                   !gossip.messages.empty() && gossip.messages.back().get() != _message_being_sent) {
+                size_t size_in_queue = gossip.messages.back()->get_size_in_queue();
+                _total_queued_messages_size -= size_in_queue;
+                gossip.size_in_bytes -= size_in_queue;
+                ++gossip.messages_dropped;
+                gossip.messages.pop_back();
+            }
+        }
+
+        fc::variants peer_connection::get_send_queue_status() const {
+            static const char *const queue_names[send_queue_class_count] = {"blocks", "transactions", "gossip"};
+            fc::variants result;
+            result.reserve(send_queue_class_count);
+            for (unsigned i = 0; i < send_queue_class_count; ++i) {
+                const send_queue &queue = _send_queues[i];
+                fc::mutable_variant_object queue_status;
+                queue_status["class"] = queue_names[i];
+                queue_status["messages"] = queue.messages.size();
+                queue_status["bytes"] = queue.size_in_bytes;
+                queue_status["sent"] = queue.messages_sent;
+                queue_status["dropped"] = queue.messages_dropped;
+                queue_status["average_latency_us"] = queue.average_latency.count();
+                result.emplace_back(std::move(queue_status));
+            }
+            return result;
+        }
+
         void peer_connection::send_queueable_message(std::unique_ptr<queued_message> &&message_to_send) {
             VERIFY_CORRECT_THREAD();
-            _total_queued_messages_size += message_to_send->get_size_in_queue();
-            _queued_messages.emplace(std::move(message_to_send));
+            size_t size_in_queue = message_to_send->get_size_in_queue();
+            send_queue &queue = _send_queues[(unsigned)message_to_send->queue_class];
+            _total_queued_messages_size += size_in_queue;
+            queue.size_in_bytes += size_in_queue;
+            queue.messages.emplace_back(std::move(message_to_send));
+            drop_gossip_messages();
             if (_total_queued_messages_size >
                 GRAPHENE_NET_MAXIMUM_QUEUED_MESSAGES_IN_BYTES) {
                 elog("send queue exceeded maximum size of ${max} bytes (current size ${current} bytes)",
@@ -341,7 +452,14 @@ namespace graphene {
             VERIFY_CORRECT_THREAD();
             //dlog("peer_connection::send_message() enqueueing message of type ${type} for peer ${endpoint}",
             //     ("type", message_to_send.msg_type)("endpoint", get_remote_endpoint()));
-            std::unique_ptr<queued_message> message_to_enqueue(new real_queued_message(message_to_send, message_send_time_field_offset));
+            std::unique_ptr<queued_message> message_to_enqueue(new real_queued_message(
+                    std::make_shared<const message>(message_to_send), message_send_time_field_offset));
+            send_queueable_message(std::move(message_to_enqueue));
+        }
+
+        void peer_connection::send_message(shared_message_ptr message_to_send) {
+            VERIFY_CORRECT_THREAD();
+            std::unique_ptr<queued_message> message_to_enqueue(new real_queued_message(std::move(message_to_send)));
             send_queueable_message(std::move(message_to_enqueue));
         }
 
@@ -31,6 +31,11 @@
 #include <fc/io/json.hpp>
 
 #include <graphene/network/peer_database.hpp>
+#include <graphene/network/config.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <random>
 
 
 namespace graphene {
@@ -58,6 +63,11 @@ namespace graphene {
             private:
                 potential_peer_set _potential_peer_set;
                 fc::path _peer_database_filename;
+                mutable std::mt19937 _random_engine{std::random_device()()};
+
+                static std::vector<potential_peer_record> load_peer_records(const fc::path &peer_database_filename);
+
+                static uint64_t get_relay_score(const potential_peer_record &record);
 
             public:
                 void open(const fc::path &databaseFilename);
@@ -74,6 +84,10 @@ namespace graphene {
 
                 fc::optional<potential_peer_record> lookup_entry_for_endpoint(const fc::ip::endpoint &endpointToLookup);
 
+                std::vector<fc::ip::endpoint> get_connection_candidates(
+                        const std::function<bool(const potential_peer_record &)> &is_eligible,
+                        std::set<uint32_t> connected_subnets) const;
+
                 peer_database::iterator begin() const;
 
                 peer_database::iterator end() const;
@@ -97,11 +111,30 @@ namespace graphene {
                     boost::iterator_facade<peer_database_iterator, const potential_peer_record, boost::forward_traversal_tag>(c) {
             }
 
+            std::vector<potential_peer_record> peer_database_impl::load_peer_records(const fc::path &peer_database_filename) {
+                std::ifstream stream(peer_database_filename.string(), std::ios::in | std::ios::binary);
+                std::vector<char> contents((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+                FC_ASSERT(!contents.empty(), "Peer database file is empty");
+
+                if (contents.front() == '[') {
+                    // saved as JSON by older versions, the next close() saves it in the binary format
+                    return fc::json::from_string(std::string(contents.begin(), contents.end())).as<std::vector<potential_peer_record>>();
+                }
+
+                fc::datastream<const char *> ds(contents.data(), contents.size());
+                uint32_t version;
+                fc::raw::unpack(ds, version);
+                FC_ASSERT(version == GRAPHENE_NET_PEER_DATABASE_VERSION, "Unknown peer database version ${version}", ("version", version));
+                std::vector<potential_peer_record> peer_records;
+                fc::raw::unpack(ds, peer_records);
+                return peer_records;
+            }
+
             void peer_database_impl::open(const fc::path &peer_database_filename) {
                 _peer_database_filename = peer_database_filename;
                 if (fc::exists(_peer_database_filename)) {
                     try {
-                        std::vector<potential_peer_record> peer_records = fc::json::from_file(_peer_database_filename).as<std::vector<potential_peer_record>>();
+                        std::vector<potential_peer_record> peer_records = load_peer_records(_peer_database_filename);
                         std::copy(peer_records.begin(), peer_records.end(), std::inserter(_potential_peer_set, _potential_peer_set.end()));
 #define MAXIMUM_PEERDB_SIZE 1000
                         if (_potential_peer_set.size() > MAXIMUM_PEERDB_SIZE) {
@@ -128,7 +161,17 @@ namespace graphene {
                     if (!fc::exists(peer_database_filename_dir)) {
                         fc::create_directories(peer_database_filename_dir);
                     }
-                    fc::json::save_to_file(peer_records, _peer_database_filename);
+                    // write a new file and replace the old one with it, so a crash can't leave a truncated database
+                    fc::path temporary_filename = peer_database_filename_dir / (_peer_database_filename.filename().string() + ".tmp");
+                    {
+                        std::ofstream stream(temporary_filename.string(), std::ios::out | std::ios::binary | std::ios::trunc);
+                        std::vector<char> packed_version = fc::raw::pack(uint32_t(GRAPHENE_NET_PEER_DATABASE_VERSION));
+                        std::vector<char> packed_records = fc::raw::pack(peer_records);
+                        stream.write(packed_version.data(), packed_version.size());
+                        stream.write(packed_records.data(), packed_records.size());
+                        FC_ASSERT(stream.good(), "Unable to write ${file}", ("file", temporary_filename));
+                    }
+                    fc::rename(temporary_filename, _peer_database_filename);
                 }
                 catch (const fc::exception &e) {
                     elog("error saving peer database to file ${peer_database_filename}",
@@ -173,6 +216,64 @@ namespace graphene {
                 return fc::optional<potential_peer_record>();
             }
 
+            uint64_t peer_database_impl::get_relay_score(const potential_peer_record &record) {
+                return uint64_t(record.block_relay_lag_ms) + record.round_trip_delay_ms / 2 +
+                       uint64_t(record.number_of_misbehaviors) * GRAPHENE_NET_PEER_MISBEHAVIOR_PENALTY_MS;
+            }
+
+            std::vector<fc::ip::endpoint> peer_database_impl::get_connection_candidates(
+                    const std::function<bool(const potential_peer_record &)> &is_eligible,
+                    std::set<uint32_t> connected_subnets) const {
+                std::vector<const potential_peer_record *> measured_peers;
+                std::vector<const potential_peer_record *> unmeasured_peers;
+                for (const potential_peer_record &record : _potential_peer_set.get<last_seen_time_index>()) {
+                    if (!is_eligible(record)) {
+                        continue;
+                    }
+                    if (record.has_relayed_blocks() || record.number_of_misbehaviors) {
+                        measured_peers.push_back(&record);
+                    } else {
+                        unmeasured_peers.push_back(&record);
+                    }
+                }
+
+                std::stable_sort(measured_peers.begin(), measured_peers.end(),
+                        [](const potential_peer_record *a, const potential_peer_record *b) {
+                            uint64_t a_score = get_relay_score(*a);
+                            uint64_t b_score = get_relay_score(*b);
+                            return a_score != b_score ? a_score < b_score : a->sync_block_rate > b->sync_block_rate;
+                        });
+                std::shuffle(unmeasured_peers.begin(), unmeasured_peers.end(), _random_engine);
+
+                // takes the best peer from a subnet not taken yet, or the best one if all of them are
+                auto take_next = [&connected_subnets](std::vector<const potential_peer_record *> &peers) {
+                    auto next = std::find_if(peers.begin(), peers.end(), [&](const potential_peer_record *record) {
+                        return connected_subnets.find(peer_database::get_subnet(record->endpoint.get_address())) ==
+                               connected_subnets.end();
+                    });
+                    if (next == peers.end()) {
+                        next = peers.begin();
+                    }
+                    const potential_peer_record *result = *next;
+                    peers.erase(next);
+                    connected_subnets.insert(peer_database::get_subnet(result->endpoint.get_address()));
+                    return result->endpoint;
+                };
+
+                std::vector<fc::ip::endpoint> candidates;
+                candidates.reserve(measured_peers.size() + unmeasured_peers.size());
+                while (!measured_peers.empty() || !unmeasured_peers.empty()) {
+                    bool exploration_slot = candidates.size() % GRAPHENE_NET_PEER_EXPLORATION_INTERVAL ==
+                                            GRAPHENE_NET_PEER_EXPLORATION_INTERVAL - 1;
+                    if (measured_peers.empty() || (exploration_slot && !unmeasured_peers.empty())) {
+                        candidates.push_back(take_next(unmeasured_peers));
+                    } else {
+                        candidates.push_back(take_next(measured_peers));
+                    }
+                }
+                return candidates;
+            }
+
             peer_database::iterator peer_database_impl::begin() const {
                 return peer_database::iterator(new peer_database_iterator_impl(_potential_peer_set.get<last_seen_time_index>().begin()));
             }
@@ -245,6 +346,12 @@ namespace graphene {
             return my->lookup_entry_for_endpoint(endpoint_to_lookup);
         }
 
+        std::vector<fc::ip::endpoint> peer_database::get_connection_candidates(
+                const std::function<bool(const potential_peer_record &)> &is_eligible,
+                std::set<uint32_t> connected_subnets) const {
+            return my->get_connection_candidates(is_eligible, std::move(connected_subnets));
+        }
+
         peer_database::iterator peer_database::begin() const {
             return my->begin();
         }
@@ -24,16 +24,41 @@
 #include <assert.h>
 
 #include <algorithm>
+#include <mutex>
+#include <vector>
 
 #include <fc/crypto/hex.hpp>
 #include <fc/crypto/aes.hpp>
 #include <fc/network/ip.hpp>
 
 #include <graphene/network/stcp_socket.hpp>
+#include <graphene/network/config.hpp>
+#include <graphene/network/offloaded_task.hpp>
 
 namespace graphene {
     namespace network {
 
+#ifndef NDEBUG
+        namespace detail {
+
+            struct check_buffer_in_use {
+                bool &_buffer_in_use;
+
+                check_buffer_in_use(bool &buffer_in_use)
+                        : _buffer_in_use(buffer_in_use) {
+                    assert(!_buffer_in_use);
+                    _buffer_in_use = true;
+                }
+
+                ~check_buffer_in_use() {
+                    assert(_buffer_in_use);
+                    _buffer_in_use = false;
+                }
+            };
+
+        } // detail
+#endif
+
         stcp_socket::stcp_socket()
 //:_buf_len(0)
 #ifndef NDEBUG
@@ -77,46 +102,26 @@ namespace graphene {
 
 /**
  *   This method must read at least 16 bytes at a time from
- *   the underlying TCP socket so that it can decrypt them. It
- *   will buffer any left-over.
+ *   the underlying TCP socket so that it can decrypt them. The
+ *   ciphertext is read straight into buffer and decrypted in place.
  */
         size_t stcp_socket::readsome(char *buffer, size_t len) {
             try {
                 assert(len > 0 && (len % 16) == 0);
 
 #ifndef NDEBUG
-                // This code was written with the assumption that you'd only be making one call to readsome
-                // at a time so it reuses _read_buffer.  If you really need to make concurrent calls to
-                // readsome(), you'll need to prevent reusing _read_buffer here
-                struct check_buffer_in_use {
-                    bool &_buffer_in_use;
-
-                    check_buffer_in_use(bool &buffer_in_use)
-                            : _buffer_in_use(buffer_in_use) {
-                        assert(!_buffer_in_use);
-                        _buffer_in_use = true;
-                    }
-
-                    ~check_buffer_in_use() {
-                        assert(_buffer_in_use);
-                        _buffer_in_use = false;
-                    }
-                } buffer_in_use_checker(_read_buffer_in_use);
+                // The aes decoder keeps the state of the stream, so the data has to be decrypted in the
+                // order it's received.  If you really need to make concurrent calls to readsome(),
+                // you'll need to serialize the decoding here
+                detail::check_buffer_in_use buffer_in_use_checker(_read_buffer_in_use);
 #endif
 
-                const size_t read_buffer_length = 4096;
-                if (!_read_buffer) {
-                    _read_buffer.reset(new char[read_buffer_length], [](char *p) { delete[] p; });
-                }
-
-                len = std::min<size_t>(read_buffer_length, len);
-
-                size_t s = _sock.readsome(_read_buffer, len, 0);
+                size_t s = _sock.readsome(buffer, len);
                 if (s % 16) {
-                    _sock.read(_read_buffer, 16 - (s % 16), s);
+                    _sock.read(buffer + s, 16 - (s % 16));
                     s += 16 - (s % 16);
                 }
-                _recv_aes.decode(_read_buffer.get(), s, buffer);
+                _recv_aes.decode(buffer, s, buffer);
                 return s;
             } FC_RETHROW_EXCEPTIONS(warn, "", ("len", len))
         }
@@ -125,49 +130,91 @@ namespace graphene {
             return readsome(buf.get() + offset, len);
         }
 
+        void stcp_socket::read_and_decode_on(fc::thread &decode_thread, char *buffer, size_t len) {
+            try {
+                assert((len % 16) == 0);
+
+                _sock.read(buffer, len);
+                // the decoder is used by one read at a time, the wait orders it with the next readsome()
+                run_offloaded_task(decode_thread, [&]() {
+                    _recv_aes.decode(buffer, len, buffer);
+                }, "stcp_socket decode");
+            } FC_RETHROW_EXCEPTIONS(warn, "", ("len", len))
+        }
+
         bool stcp_socket::eof() const {
             return _sock.eof();
         }
 
+        namespace detail {
+
+            /**
+             *  Ciphertext buffers shared by all sockets. Buffers keep their size, so once
+             *  the pool has warmed up, frames are encrypted without allocating memory.
+             */
+            class frame_buffer_pool {
+            public:
+                std::vector<char> acquire(size_t size) {
+                    std::vector<char> buffer;
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        if (!_buffers.empty()) {
+                            buffer = std::move(_buffers.back());
+                            _buffers.pop_back();
+                        }
+                    }
+                    if (buffer.size() < size) {
+                        buffer.resize(size);
+                    }
+                    return buffer;
+                }
+
+                void release(std::vector<char> &&buffer) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_buffers.size() < GRAPHENE_NET_MAX_POOLED_FRAME_BUFFERS) {
+                        _buffers.push_back(std::move(buffer));
+                    }
+                }
+
+            private:
+                std::mutex _mutex;
+                std::vector<std::vector<char>> _buffers;
+            };
+
+            static frame_buffer_pool &get_frame_buffer_pool() {
+                static frame_buffer_pool pool;
+                return pool;
+            }
+
+            struct pooled_frame_buffer {
+                std::vector<char> buffer;
+
+                pooled_frame_buffer(size_t size)
+                        : buffer(get_frame_buffer_pool().acquire(size)) {
+                }
+
+                ~pooled_frame_buffer() {
+                    get_frame_buffer_pool().release(std::move(buffer));
+                }
+            };
+
+        } // detail
+
         size_t stcp_socket::writesome(const char *buffer, size_t len) {
             try {
                 assert(len > 0 && (len % 16) == 0);
 
 #ifndef NDEBUG
-                // This code was written with the assumption that you'd only be making one call to writesome
-                // at a time so it reuses _write_buffer.  If you really need to make concurrent calls to
-                // writesome(), you'll need to prevent reusing _write_buffer here
-                struct check_buffer_in_use {
-                    bool &_buffer_in_use;
-
-                    check_buffer_in_use(bool &buffer_in_use)
-                            : _buffer_in_use(buffer_in_use) {
-                        assert(!_buffer_in_use);
-                        _buffer_in_use = true;
-                    }
-
-                    ~check_buffer_in_use() {
-                        assert(_buffer_in_use);
-                        _buffer_in_use = false;
-                    }
-                } buffer_in_use_checker(_write_buffer_in_use);
+                // The aes encoder keeps the state of the stream, so the data has to be encrypted in the
+                // order it's sent.  If you really need to make concurrent calls to writesome(),
+                // you'll need to serialize the encoding here
+                detail::check_buffer_in_use buffer_in_use_checker(_write_buffer_in_use);
 #endif
 
-                const std::size_t write_buffer_length = 4096;
-                if (!_write_buffer) {
-                    _write_buffer.reset(new char[write_buffer_length], [](char *p) { delete[] p; });
-                }
-                len = std::min<size_t>(write_buffer_length, len);
-                memset(_write_buffer.get(), 0, len); // just in case aes.encode screws up
-                /**
-                 * every sizeof(crypt_buf) bytes the aes channel
-                 * has an error and doesn't decrypt properly...  disable
-                 * for now because we are going to upgrade to something
-                 * better.
-                 */
-                uint32_t ciphertext_len = _send_aes.encode(buffer, len, _write_buffer.get());
+                detail::pooled_frame_buffer ciphertext(len);
+                uint32_t ciphertext_len = _send_aes.encode(buffer, len, ciphertext.buffer.data());
                 assert(ciphertext_len == len);
-                _sock.write(_write_buffer, ciphertext_len);
+                _sock.write(ciphertext.buffer.data(), ciphertext_len);
                 return ciphertext_len;
             } FC_RETHROW_EXCEPTIONS(warn, "", ("len", len))
         }
@@ -176,6 +223,54 @@ namespace graphene {
             return writesome(buf.get() + offset, len);
         }
 
+        void stcp_socket::write_frame(const char *header, size_t header_len, const char *body, size_t body_len,
+                fc::thread *encode_thread) {
+            try {
+                assert(header_len <= 16);
+
+#ifndef NDEBUG
+                detail::check_buffer_in_use buffer_in_use_checker(_write_buffer_in_use);
+#endif
+
+                const size_t frame_len = 16 * ((header_len + body_len + 15) / 16);
+                detail::pooled_frame_buffer ciphertext(frame_len);
+
+                auto encode = [&]() {
+                    char *out = ciphertext.buffer.data();
+                    char block[16] = {};
+
+                    // the first block holds the header and the beginning of the body
+                    size_t body_pos = std::min<size_t>(16 - header_len, body_len);
+                    memcpy(block, header, header_len);
+                    memcpy(block + header_len, body, body_pos);
+                    size_t out_pos = _send_aes.encode(block, sizeof(block), out);
+
+                    // whole blocks are encrypted straight from the body, without copying them first
+                    size_t whole_blocks_len = (body_len - body_pos) / 16 * 16;
+                    if (whole_blocks_len) {
+                        out_pos += _send_aes.encode(body + body_pos, whole_blocks_len, out + out_pos);
+                        body_pos += whole_blocks_len;
+                    }
+
+                    // and the rest is zero padded
+                    if (body_pos < body_len) {
+                        memset(block, 0, sizeof(block));
+                        memcpy(block, body + body_pos, body_len - body_pos);
+                        out_pos += _send_aes.encode(block, sizeof(block), out + out_pos);
+                    }
+                    assert(out_pos == frame_len);
+                };
+
+                // the encoder works on the caller's body and the pooled buffer, don't return before it has finished
+                if (encode_thread != nullptr) {
+                    run_offloaded_task(*encode_thread, encode, "stcp_socket encode");
+                } else {
+                    encode();
+                }
+                _sock.write(ciphertext.buffer.data(), frame_len);
+            } FC_RETHROW_EXCEPTIONS(warn, "", ("header_len", header_len)("body_len", body_len))
+        }
+
         void stcp_socket::flush() {
             _sock.flush();
         }
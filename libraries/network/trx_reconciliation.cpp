@@ -0,0 +1,116 @@
+#include <graphene/network/trx_reconciliation.hpp>
+#include <graphene/network/config.hpp>
+
+#include <fc/crypto/city.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace graphene {
+    namespace network {
+
+        namespace detail {
+
+            /// each id is put into one cell of each of the three subtables
+            static const uint32_t sketch_hash_count = 3;
+
+            inline uint32_t mix_short_id(uint32_t short_id, uint32_t seed) {
+                // finalizer of murmur3, ids are already random, it only has to spread them differently per seed
+                uint32_t h = short_id ^ (seed * 0x9e3779b9);
+                h ^= h >> 16;
+                h *= 0x85ebca6b;
+                h ^= h >> 13;
+                h *= 0xc2b2ae35;
+                h ^= h >> 16;
+                return h;
+            }
+
+        } // detail
+
+        uint64_t get_trx_reconciliation_salt(uint64_t our_salt, uint64_t their_salt) {
+            uint64_t salts[2] = {std::min(our_salt, their_salt), std::max(our_salt, their_salt)};
+            return fc::city_hash64((const char *)salts, sizeof(salts));
+        }
+
+        uint32_t get_short_trx_id(uint64_t salt, const item_hash_t &trx_message_id) {
+            char data[sizeof(salt) + sizeof(trx_message_id)];
+            std::memcpy(data, &salt, sizeof(salt));
+            std::memcpy(data + sizeof(salt), trx_message_id.data(), sizeof(trx_message_id));
+            return (uint32_t)fc::city_hash64(data, sizeof(data));
+        }
+
+        size_t trx_reconciliation_sketch::get_cell_count(uint32_t capacity) {
+            // peeling needs about 1.23 cells per id for large differences and more for small ones,
+            // this makes failures rare enough to be cheaper than larger sketches
+            return detail::sketch_hash_count * (capacity * 2 / 3 + 4);
+        }
+
+        trx_reconciliation_sketch::trx_reconciliation_sketch(uint32_t capacity)
+                : cells(get_cell_count(capacity)) {
+        }
+
+        trx_reconciliation_sketch::trx_reconciliation_sketch(std::vector<trx_reconciliation_sketch_cell> &&cells)
+                : cells(std::move(cells)) {
+            FC_ASSERT(!this->cells.empty() && this->cells.size() % detail::sketch_hash_count == 0 &&
+                      this->cells.size() <= get_cell_count(2 * GRAPHENE_NET_MAX_TRX_RECONCILIATION_SET_SIZE),
+                    "Invalid transaction reconciliation sketch of ${n} cells", ("n", this->cells.size()));
+        }
+
+        void trx_reconciliation_sketch::toggle(uint32_t short_id, int32_t count) {
+            const size_t subtable_size = cells.size() / detail::sketch_hash_count;
+            const uint32_t check_sum = detail::mix_short_id(short_id, detail::sketch_hash_count);
+            for (uint32_t i = 0; i < detail::sketch_hash_count; ++i) {
+                trx_reconciliation_sketch_cell &cell = cells[i * subtable_size + detail::mix_short_id(short_id, i) % subtable_size];
+                cell.count += count;
+                cell.id_sum ^= short_id;
+                cell.check_sum ^= check_sum;
+            }
+        }
+
+        void trx_reconciliation_sketch::add(uint32_t short_id) {
+            toggle(short_id, 1);
+        }
+
+        void trx_reconciliation_sketch::subtract(const trx_reconciliation_sketch &other) {
+            FC_ASSERT(cells.size() == other.cells.size());
+            for (size_t i = 0; i < cells.size(); ++i) {
+                cells[i].count -= other.cells[i].count;
+                cells[i].id_sum ^= other.cells[i].id_sum;
+                cells[i].check_sum ^= other.cells[i].check_sum;
+            }
+        }
+
+        bool trx_reconciliation_sketch::decode(std::vector<uint32_t> &only_ours, std::vector<uint32_t> &only_theirs) const {
+            trx_reconciliation_sketch remaining(*this);
+            auto is_pure = [](const trx_reconciliation_sketch_cell &cell) {
+                return (cell.count == 1 || cell.count == -1) &&
+                       cell.check_sum == detail::mix_short_id(cell.id_sum, detail::sketch_hash_count);
+            };
+
+            // peel cells holding a single id until none are left
+            bool peeled = true;
+            while (peeled) {
+                peeled = false;
+                for (const trx_reconciliation_sketch_cell &cell : remaining.cells) {
+                    if (is_pure(cell)) {
+                        uint32_t short_id = cell.id_sum;
+                        int32_t count = cell.count;
+                        (count > 0 ? only_ours : only_theirs).push_back(short_id);
+                        if (only_ours.size() + only_theirs.size() > remaining.cells.size()) {
+                            // a sketch can't list more ids than it has cells, unless a peer made it up
+                            return false;
+                        }
+                        remaining.toggle(short_id, -count);
+                        peeled = true;
+                    }
+                }
+            }
+
+            return std::all_of(remaining.cells.begin(), remaining.cells.end(), [](const trx_reconciliation_sketch_cell &cell) {
+                return cell.count == 0 && cell.id_sum == 0 && cell.check_sum == 0;
+            });
+        }
+
+    }
+} // graphene::network
@@ -12,12 +12,18 @@
 // for api
 #include <fc/optional.hpp>
 
+#include <exception>
+#include <functional>
+
 namespace graphene {
     namespace plugins {
         namespace chain {
 
             using graphene::plugins::json_rpc::msg_pack;
 
+            /// called with the exception a transaction was rejected with, or with nullptr if it was accepted
+            using accept_transaction_callback = std::function<void(std::exception_ptr)>;
+
             class plugin final : public appbase::plugin<plugin> {
             public:
                 APPBASE_PLUGIN_REQUIRES((json_rpc::plugin))
@@ -45,6 +51,13 @@ namespace graphene {
 
                 void accept_transaction(const protocol::signed_transaction &trx);
 
+                /**
+                 *  Queues the transaction for admission without waiting for it. Transactions are validated
+                 *  in parallel on the transaction-validation-threads and the valid ones are pushed in
+                 *  batches under one write lock. The callback is called from one of these threads.
+                 */
+                void accept_transaction_async(const protocol::signed_transaction &trx, accept_transaction_callback callback);
+
                 bool block_is_on_preferred_chain(const protocol::block_id_type &block_id);
 
                 void check_time_in_block(const protocol::signed_block &block);
@@ -8,7 +8,14 @@
 #include <iostream>
 #include <graphene/protocol/protocol.hpp>
 #include <graphene/protocol/types.hpp>
+#include <atomic>
+#include <deque>
 #include <future>
+#include <mutex>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
 
 namespace graphene {
 namespace plugins {
@@ -54,6 +61,25 @@ namespace chain {
 
         bool single_write_thread = false;
 
+        // transaction admission: validation in parallel, then pushing in batches
+        struct validated_transaction {
+            protocol::signed_transaction trx;
+            uint32_t skip;
+            accept_transaction_callback callback;
+        };
+
+        uint32_t transaction_validation_threads = 0;
+        uint32_t max_transaction_batch_size = 0;
+        std::unique_ptr<boost::asio::io_service> validation_ios;
+        std::unique_ptr<boost::asio::io_service::work> validation_work;
+        boost::thread_group validation_thread_pool;
+
+        std::mutex validated_transactions_mutex;
+        std::deque<validated_transaction> validated_transactions;
+        bool pushing_transactions = false;
+        // set under validated_transactions_mutex, after it no transaction is queued and callbacks get an error
+        std::atomic<bool> validation_stopping{false};
+
         plugin_impl() {
             // get default settings
             read_wait_micro = db.read_wait_micro();
@@ -81,6 +107,10 @@ namespace chain {
         void check_time_in_block(const protocol::signed_block &block);
         bool accept_block(const protocol::signed_block &block, bool currently_syncing, uint32_t skip);
         void accept_transaction(const protocol::signed_transaction &trx);
+        void accept_transaction_async(const protocol::signed_transaction &trx, accept_transaction_callback &&callback);
+        void push_validated_transactions();
+        void stop_transaction_validation();
+        static std::exception_ptr shutdown_error();
         void wipe_db(const bfs::path &data_dir, bool wipe_block_log);
         void replay_db(const bfs::path &data_dir, bool force_replay);
     };
@@ -166,6 +196,122 @@ namespace chain {
         }
     }
 
+    void plugin::plugin_impl::accept_transaction_async(const protocol::signed_transaction &trx,
+                                                       accept_transaction_callback &&callback) {
+        if (!validation_ios) {
+            std::exception_ptr error;
+            try {
+                accept_transaction(trx);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            callback(error);
+            return;
+        }
+
+        auto task = std::make_shared<validated_transaction>(validated_transaction{trx, 0, std::move(callback)});
+        // posted under the lock, so stop_transaction_validation() runs every task queued before it
+        std::unique_lock<std::mutex> lock(validated_transactions_mutex);
+        if (validation_stopping) {
+            lock.unlock();
+            task->callback(shutdown_error());
+            return;
+        }
+        validation_ios->post([this, task]() {
+            if (validation_stopping) {
+                task->callback(shutdown_error());
+                return;
+            }
+
+            try {
+                task->skip = db.validate_transaction(task->trx, db.skip_apply_transaction);
+            } catch (...) {
+                task->callback(std::current_exception());
+                return;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(validated_transactions_mutex);
+                if (validation_stopping) {
+                    lock.unlock();
+                    task->callback(shutdown_error());
+                    return;
+                }
+                validated_transactions.emplace_back(std::move(*task));
+                if (pushing_transactions) {
+                    // the thread pushing now takes it with the next batch
+                    return;
+                }
+                pushing_transactions = true;
+            }
+
+            if (single_write_thread) {
+                io_service().post([this]() { push_validated_transactions(); });
+            } else {
+                push_validated_transactions();
+            }
+        });
+    }
+
+    void plugin::plugin_impl::push_validated_transactions() {
+        for (;;) {
+            std::vector<protocol::signed_transaction> trxs;
+            std::vector<accept_transaction_callback> callbacks;
+            uint32_t skip = 0;
+            {
+                std::lock_guard<std::mutex> lock(validated_transactions_mutex);
+                if (validated_transactions.empty()) {
+                    pushing_transactions = false;
+                    return;
+                }
+                // everything validated while the previous batch was pushed goes in one lock acquisition
+                skip = validated_transactions.front().skip;
+                while (!validated_transactions.empty() && trxs.size() < max_transaction_batch_size &&
+                       validated_transactions.front().skip == skip) {
+                    trxs.emplace_back(std::move(validated_transactions.front().trx));
+                    callbacks.emplace_back(std::move(validated_transactions.front().callback));
+                    validated_transactions.pop_front();
+                }
+            }
+
+            auto results = db.push_transactions(trxs, skip);
+            for (size_t i = 0; i < callbacks.size(); ++i) {
+                callbacks[i](results[i]);
+            }
+        }
+    }
+
+    std::exception_ptr plugin::plugin_impl::shutdown_error() {
+        try {
+            FC_THROW("Node is shutting down");
+        } catch (...) {
+            return std::current_exception();
+        }
+    }
+
+    void plugin::plugin_impl::stop_transaction_validation() {
+        {
+            std::lock_guard<std::mutex> lock(validated_transactions_mutex);
+            validation_stopping = true;
+        }
+
+        // the queued tasks only call their callbacks with an error now, let them run out
+        validation_work.reset();
+        validation_thread_pool.join_all();
+
+        // validated transactions waiting for a push which won't happen anymore,
+        // e.g. posted to the application io_service after it was stopped
+        std::deque<validated_transaction> not_pushed;
+        {
+            std::lock_guard<std::mutex> lock(validated_transactions_mutex);
+            not_pushed.swap(validated_transactions);
+            pushing_transactions = false;
+        }
+        for (auto &item : not_pushed) {
+            item.callback(shutdown_error());
+        }
+    }
+
     plugin::plugin() {
     }
 
@@ -219,6 +365,12 @@ namespace chain {
             ) (
                 "single-write-thread", boost::program_options::value<bool>()->default_value(false),
                 "push blocks and transactions from one thread"
+            ) (
+                "transaction-validation-threads", boost::program_options::value<uint32_t>()->default_value(2),
+                "number of threads validating incoming transactions in parallel, 0 to validate them in the receiving thread"
+            ) (
+                "max-transaction-batch-size", boost::program_options::value<uint32_t>()->default_value(500),
+                "maximum number of validated transactions pushed under one write lock"
             ) (
                 "clear-votes-before-block", boost::program_options::value<uint32_t>()->default_value(0),
                 "remove votes before defined block, should speedup initial synchronization"
@@ -279,6 +431,8 @@ namespace chain {
         }
 
         my->single_write_thread = options.at("single-write-thread").as<bool>();
+        my->transaction_validation_threads = options.at("transaction-validation-threads").as<uint32_t>();
+        my->max_transaction_batch_size = std::max<uint32_t>(1, options.at("max-transaction-batch-size").as<uint32_t>());
 
         my->enable_plugins_on_push_transaction = options.at("enable-plugins-on-push-transaction").as<bool>();
 
@@ -303,6 +457,10 @@ namespace chain {
             my->flush_interval = 10000;
         }
 
+        my->db.applied_block.connect([](const protocol::signed_block &) {
+            appbase::app().get_plugin<json_rpc::plugin>().clear_cache();
+        });
+
         if (options.count("checkpoint")) {
             auto cps = options.at("checkpoint").as<std::vector<std::string>>();
             my->loaded_checkpoints.reserve(cps.size());
@@ -385,11 +543,23 @@ namespace chain {
             }
         }
 
+        if (my->transaction_validation_threads) {
+            my->validation_ios.reset(new boost::asio::io_service());
+            my->validation_work.reset(new boost::asio::io_service::work(*my->validation_ios));
+            for (uint32_t i = 0; i < my->transaction_validation_threads; ++i) {
+                my->validation_thread_pool.create_thread(boost::bind(&boost::asio::io_service::run, my->validation_ios.get()));
+            }
+        }
+
         ilog("Started on blockchain with ${n} blocks", ("n", my->db.head_block_num()));
         on_sync();
     }
 
     void plugin::plugin_shutdown() {
+        if (my->validation_ios) {
+            my->stop_transaction_validation();
+        }
+
         ilog("closing chain database");
         my->db.close();
         ilog("database closed successfully");
@@ -400,7 +570,25 @@ namespace chain {
     }
 
     void plugin::accept_transaction(const protocol::signed_transaction &trx) {
-        my->accept_transaction(trx);
+        if (!my->validation_ios) {
+            my->accept_transaction(trx);
+            return;
+        }
+
+        std::promise<void> promise;
+        auto result = promise.get_future();
+        my->accept_transaction_async(trx, [&promise](std::exception_ptr error) {
+            if (error) {
+                promise.set_exception(error);
+            } else {
+                promise.set_value();
+            }
+        });
+        result.get(); // if an exception was, it will be thrown
+    }
+
+    void plugin::accept_transaction_async(const protocol::signed_transaction &trx, accept_transaction_callback callback) {
+        my->accept_transaction_async(trx, std::move(callback));
     }
 
     bool plugin::block_is_on_preferred_chain(const protocol::block_id_type &block_id) {
@@ -0,0 +1,434 @@
+#include <graphene/plugins/json_rpc/fast_json.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/string.hpp>
+#include <fc/variant_object.hpp>
+
+#include <cctype>
+#include <cstring>
+#include <limits>
+
+namespace graphene {
+    namespace plugins {
+        namespace json_rpc {
+            namespace fast_json {
+
+                namespace {
+
+                    const uint64_t low_bits = 0x0101010101010101ULL;
+                    const uint64_t high_bits = 0x8080808080808080ULL;
+                    const size_t max_depth = 256;
+
+                    inline uint64_t load_word(const char *p) {
+                        uint64_t word;
+                        memcpy(&word, p, sizeof(word));
+                        return word;
+                    }
+
+                    /// nonzero if one of the bytes of word is byte
+                    inline uint64_t has_byte(uint64_t word, uint8_t byte) {
+                        uint64_t x = word ^ (low_bits * byte);
+                        return (x - low_bits) & ~x & high_bits;
+                    }
+
+                    /// nonzero if one of the bytes of word is a control character
+                    inline uint64_t has_control_byte(uint64_t word) {
+                        return (word - low_bits * 0x20) & ~word & high_bits;
+                    }
+
+                    inline bool is_token_char(char c) {
+                        return std::isalnum((unsigned char)c) || c == '_' || c == '-' || c == '.';
+                    }
+
+                    /**
+                     * Recursive descent over plain JSON, every method returns false for input
+                     * the fast path leaves to fc::json
+                     */
+                    class parser {
+                    public:
+                        parser(const char *begin, const char *end)
+                                : _pos(begin), _end(end) {
+                        }
+
+                        bool parse(fc::variant &result) {
+                            skip_white_space();
+                            if (!parse_value(result, 0)) {
+                                return false;
+                            }
+                            skip_white_space();
+                            return _pos == _end;
+                        }
+
+                    private:
+                        void skip_white_space() {
+                            while (_pos != _end && (*_pos == ' ' || *_pos == '\n' || *_pos == '\r' || *_pos == '\t')) {
+                                ++_pos;
+                            }
+                        }
+
+                        bool parse_value(fc::variant &result, size_t depth) {
+                            if (_pos == _end || depth > max_depth) {
+                                return false;
+                            }
+                            switch (*_pos) {
+                                case '{':
+                                    return parse_object(result, depth);
+                                case '[':
+                                    return parse_array(result, depth);
+                                case '"': {
+                                    std::string value;
+                                    if (!parse_string(value)) {
+                                        return false;
+                                    }
+                                    result = fc::variant(std::move(value));
+                                    return true;
+                                }
+                                case 't':
+                                    return parse_literal("true", fc::variant(true), result);
+                                case 'f':
+                                    return parse_literal("false", fc::variant(false), result);
+                                case 'n':
+                                    return parse_literal("null", fc::variant(), result);
+                                default:
+                                    return parse_number(result);
+                            }
+                        }
+
+                        bool parse_literal(const char *literal, fc::variant value, fc::variant &result) {
+                            size_t size = strlen(literal);
+                            if (size_t(_end - _pos) < size || memcmp(_pos, literal, size) != 0) {
+                                return false;
+                            }
+                            _pos += size;
+                            if (_pos != _end && is_token_char(*_pos)) {
+                                return false;
+                            }
+                            result = std::move(value);
+                            return true;
+                        }
+
+                        bool parse_string(std::string &result) {
+                            ++_pos; // opening quote
+                            const char *chunk_start = _pos;
+                            while (true) {
+                                while (_end - _pos >= 8) {
+                                    uint64_t word = load_word(_pos);
+                                    if (has_byte(word, '"') | has_byte(word, '\\') | has_byte(word, 0x04)) {
+                                        break;
+                                    }
+                                    _pos += 8;
+                                }
+                                while (_pos != _end && *_pos != '"' && *_pos != '\\' && *_pos != 0x04) {
+                                    ++_pos;
+                                }
+                                if (_pos == _end || *_pos == 0x04) {
+                                    // fc::json takes 0x04 for the end of input
+                                    return false;
+                                }
+
+                                result.append(chunk_start, _pos);
+                                if (*_pos == '"') {
+                                    ++_pos;
+                                    return true;
+                                }
+
+                                if (++_pos == _end) {
+                                    return false;
+                                }
+                                switch (*_pos) {
+                                    case 't':
+                                        result += '\t';
+                                        break;
+                                    case 'n':
+                                        result += '\n';
+                                        break;
+                                    case 'r':
+                                        result += '\r';
+                                        break;
+                                    case '"':
+                                    case '\\':
+                                    case '/':
+                                        result += *_pos;
+                                        break;
+                                    default:
+                                        return false;
+                                }
+                                chunk_start = ++_pos;
+                            }
+                        }
+
+                        bool parse_number(fc::variant &result) {
+                            const char *start = _pos;
+                            bool negative = false;
+                            if (*_pos == '-') {
+                                negative = true;
+                                ++_pos;
+                            }
+
+                            const char *digits = _pos;
+                            uint64_t value = 0;
+                            bool overflow = false;
+                            for (; _pos != _end && *_pos >= '0' && *_pos <= '9'; ++_pos) {
+                                uint64_t digit = uint64_t(*_pos - '0');
+                                if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10) {
+                                    overflow = true;
+                                }
+                                value = value * 10 + digit;
+                            }
+
+                            bool dot = false;
+                            if (_pos != _end && *_pos == '.') {
+                                dot = true;
+                                ++_pos;
+                                while (_pos != _end && *_pos >= '0' && *_pos <= '9') {
+                                    ++_pos;
+                                }
+                            }
+
+                            // fc::json reads numbers followed by letters (like exponents) as strings
+                            if (_pos == digits || (dot && _pos - digits == 1) ||
+                                (_pos != _end && std::isalnum((unsigned char)*_pos))) {
+                                return false;
+                            }
+
+                            if (dot) {
+                                result = fc::variant(fc::to_double(std::string(start, _pos)));
+                            } else if (overflow) {
+                                return false;
+                            } else if (negative) {
+                                if (value > uint64_t(std::numeric_limits<int64_t>::max()) + 1) {
+                                    return false;
+                                }
+                                result = fc::variant(int64_t(0 - value));
+                            } else {
+                                result = fc::variant(value);
+                            }
+                            return true;
+                        }
+
+                        bool parse_array(fc::variant &result, size_t depth) {
+                            ++_pos; // [
+                            fc::variants array;
+                            skip_white_space();
+                            if (_pos != _end && *_pos == ']') {
+                                ++_pos;
+                                result = fc::variant(std::move(array));
+                                return true;
+                            }
+                            while (true) {
+                                skip_white_space();
+                                array.emplace_back();
+                                if (!parse_value(array.back(), depth + 1)) {
+                                    return false;
+                                }
+                                skip_white_space();
+                                if (_pos == _end) {
+                                    return false;
+                                }
+                                if (*_pos == ',') {
+                                    ++_pos;
+                                } else if (*_pos == ']') {
+                                    ++_pos;
+                                    result = fc::variant(std::move(array));
+                                    return true;
+                                } else {
+                                    return false;
+                                }
+                            }
+                        }
+
+                        bool parse_object(fc::variant &result, size_t depth) {
+                            ++_pos; // {
+                            fc::mutable_variant_object object;
+                            skip_white_space();
+                            if (_pos != _end && *_pos == '}') {
+                                ++_pos;
+                                result = fc::variant(std::move(object));
+                                return true;
+                            }
+                            while (true) {
+                                skip_white_space();
+                                std::string key;
+                                if (_pos == _end || *_pos != '"' || !parse_string(key)) {
+                                    return false;
+                                }
+                                skip_white_space();
+                                if (_pos == _end || *_pos != ':') {
+                                    return false;
+                                }
+                                ++_pos;
+                                skip_white_space();
+                                fc::variant value;
+                                if (!parse_value(value, depth + 1)) {
+                                    return false;
+                                }
+                                object(std::move(key), std::move(value));
+                                skip_white_space();
+                                if (_pos == _end) {
+                                    return false;
+                                }
+                                if (*_pos == ',') {
+                                    ++_pos;
+                                } else if (*_pos == '}') {
+                                    ++_pos;
+                                    result = fc::variant(std::move(object));
+                                    return true;
+                                } else {
+                                    return false;
+                                }
+                            }
+                        }
+
+                        const char *_pos;
+                        const char *_end;
+                    };
+
+                    void write_string(const std::string &value, std::string &out) {
+                        static const char hex_digits[] = "0123456789abcdef";
+
+                        out += '"';
+                        const char *pos = value.data();
+                        const char *end = pos + value.size();
+                        const char *chunk_start = pos;
+                        while (pos != end) {
+                            if (end - pos >= 8) {
+                                uint64_t word = load_word(pos);
+                                if (!(has_byte(word, '"') | has_byte(word, '\\') | has_control_byte(word))) {
+                                    pos += 8;
+                                    continue;
+                                }
+                            }
+
+                            unsigned char c = (unsigned char)*pos;
+                            if (c == '"' || c == '\\' || c < 0x20) {
+                                out.append(chunk_start, pos);
+                                out += '\\';
+                                switch (c) {
+                                    case '"':
+                                    case '\\':
+                                        out += char(c);
+                                        break;
+                                    case '\b':
+                                        out += 'b';
+                                        break;
+                                    case '\f':
+                                        out += 'f';
+                                        break;
+                                    case '\n':
+                                        out += 'n';
+                                        break;
+                                    case '\r':
+                                        out += 'r';
+                                        break;
+                                    case '\t':
+                                        out += 't';
+                                        break;
+                                    default:
+                                        out += "u00";
+                                        out += hex_digits[c >> 4];
+                                        out += hex_digits[c & 0xf];
+                                }
+                                chunk_start = pos + 1;
+                            }
+                            ++pos;
+                        }
+                        out.append(chunk_start, end);
+                        out += '"';
+                    }
+
+                } // anonymous namespace
+
+                fc::variant from_string(const std::string &json) {
+                    fc::variant result;
+                    parser fast_parser(json.data(), json.data() + json.size());
+                    if (fast_parser.parse(result)) {
+                        return result;
+                    }
+                    return fc::json::from_string(json);
+                }
+
+                void write(const fc::variant &value, std::string &out) {
+                    switch (value.get_type()) {
+                        case fc::variant::null_type:
+                            out += "null";
+                            return;
+                        case fc::variant::int64_type: {
+                            int64_t i = value.as_int64();
+                            if (i > 0xffffffff) {
+                                out += '"';
+                                out += std::to_string(i);
+                                out += '"';
+                            } else {
+                                out += std::to_string(i);
+                            }
+                            return;
+                        }
+                        case fc::variant::uint64_type: {
+                            uint64_t i = value.as_uint64();
+                            if (i > 0xffffffff) {
+                                out += '"';
+                                out += std::to_string(i);
+                                out += '"';
+                            } else {
+                                out += std::to_string(i);
+                            }
+                            return;
+                        }
+                        case fc::variant::double_type:
+                            out += '"';
+                            out += value.as_string();
+                            out += '"';
+                            return;
+                        case fc::variant::bool_type:
+                            out += value.as_bool() ? "true" : "false";
+                            return;
+                        case fc::variant::string_type:
+                            write_string(value.get_string(), out);
+                            return;
+                        case fc::variant::blob_type:
+                            write_string(value.as_string(), out);
+                            return;
+                        case fc::variant::array_type: {
+                            out += '[';
+                            bool first = true;
+                            for (const fc::variant &element : value.get_array()) {
+                                if (!first) {
+                                    out += ',';
+                                }
+                                first = false;
+                                write(element, out);
+                            }
+                            out += ']';
+                            return;
+                        }
+                        case fc::variant::object_type: {
+                            out += '{';
+                            bool first = true;
+                            for (const auto &entry : value.get_object()) {
+                                if (!first) {
+                                    out += ',';
+                                }
+                                first = false;
+                                write_string(entry.key(), out);
+                                out += ':';
+                                write(entry.value(), out);
+                            }
+                            out += '}';
+                            return;
+                        }
+                        default:
+                            FC_THROW_EXCEPTION(fc::invalid_arg_exception, "Unknown variant type: ${type}",
+                                               ("type", (int)value.get_type()));
+                    }
+                }
+
+                std::string to_string(const fc::variant &value) {
+                    std::string out;
+                    write(value, out);
+                    return out;
+                }
+
+            }
+        }
+    }
+} // graphene::plugins::json_rpc::fast_json
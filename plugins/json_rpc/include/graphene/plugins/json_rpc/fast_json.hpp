@@ -0,0 +1,32 @@
+#pragma once
+
+#include <fc/variant.hpp>
+
+#include <string>
+
+namespace graphene {
+    namespace plugins {
+        namespace json_rpc {
+            namespace fast_json {
+
+                /**
+                 * @brief Parses JSON into the same variant fc::json::from_string() makes.
+                 *
+                 * Strings are scanned a machine word at a time. Input outside of plain JSON
+                 * (exponents, bare tokens, nesting too deep, malformed text) is handed to
+                 * fc::json::from_string(), so it's parsed and rejected exactly as before.
+                 */
+                fc::variant from_string(const std::string &json);
+
+                /**
+                 * @brief Appends the JSON of a variant to out, formatted as fc::json::to_string() does:
+                 * integers over 32 bits and doubles are written as strings.
+                 */
+                void write(const fc::variant &value, std::string &out);
+
+                std::string to_string(const fc::variant &value);
+
+            }
+        }
+    }
+} // graphene::plugins::json_rpc::fast_json
@@ -85,6 +85,11 @@ namespace graphene {
             public:
                 using response_handler_type = std::function<void (const std::string &)>;
 
+                using task_executor_type = std::function<void (std::function<void()>)>;
+
+                /// Gets the number of entries of a batch request, which is rejected when it returns false
+                using batch_admission_type = std::function<bool (size_t)>;
+
                 plugin();
 
                 ~plugin();
@@ -92,8 +97,7 @@ namespace graphene {
                 APPBASE_PLUGIN_REQUIRES();
 
                 void set_program_options(boost::program_options::options_description &,
-                                         boost::program_options::options_description &) override {
-                }
+                                         boost::program_options::options_description &) override;
 
                 static const std::string &name() {
                     static std::string name = JSON_RPC_PLUGIN_NAME;
@@ -109,7 +113,31 @@ namespace graphene {
                 void add_api_method(const string &api_name, const string &method_name,
                                     const api_method &api/*, const api_method_signature& sig */);
 
-                void call(const string &body, response_handler_type);
+                void call(const string &body, response_handler_type, batch_admission_type = batch_admission_type());
+
+                /**
+                 * @brief Replies to the request with a server error without calling it,
+                 * e.g. when the client has sent too many requests.
+                 * The request isn't parsed, so the error has a null id, also for a batch.
+                 */
+                void reject(const string &message, response_handler_type);
+
+                /**
+                 * @brief Sets where entries of batch requests are run in parallel,
+                 * without an executor they are run one after another on the calling thread.
+                 * Must be set before requests arrive.
+                 */
+                void set_task_executor(task_executor_type);
+
+                /**
+                 * @brief Drops the cached responses, called on every applied block.
+                 */
+                void clear_cache();
+
+                /**
+                 * @brief Returns the counters of the called methods in Prometheus text format.
+                 */
+                std::string prometheus_stats() const;
 
             private:
                 class impl;
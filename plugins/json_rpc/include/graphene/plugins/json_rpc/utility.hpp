@@ -1,6 +1,8 @@
 #pragma once
 
 #include <type_traits>
+#include <memory>
+#include <string>
 
 #include <fc/reflect/reflect.hpp>
 #include <boost/preprocessor/seq/for_each.hpp>
@@ -43,6 +45,8 @@ api_name ## _return class :: api_name ( api_name ## _args& args )
 namespace graphene {
     namespace plugins {
         namespace json_rpc {
+            struct method_stats;
+
             class msg_pack final {
             public:
                 fc::variant id;
@@ -70,11 +74,20 @@ namespace graphene {
 
                 fc::optional<fc::variant> rpc_id() const;
 
+                // Account the response in the stats of the called method
+                void stats(method_stats *);
+
+                // Account the time the call waited for the database lock in the stats
+                void lock_wait(uint64_t microseconds);
+
                 // Pass result to remote connection
                 void result(fc::optional<fc::variant> result);
 
                 void unsafe_result(fc::optional<fc::variant> result);
 
+                // Pass result which is already serialized to JSON
+                void serialized_result(std::shared_ptr<const std::string> result);
+
                 fc::optional<fc::variant> result() const;
 
                 // Pass error to remote connection
@@ -1,13 +1,24 @@
 #include <graphene/plugins/json_rpc/plugin.hpp>
 #include <graphene/plugins/json_rpc/utility.hpp>
+#include <graphene/plugins/json_rpc/fast_json.hpp>
+#include <graphene/chain/database.hpp>
 
 #include <boost/algorithm/string.hpp>
 
 #include <fc/log/logger_config.hpp>
 #include <fc/exception/exception.hpp>
+#include <fc/string.hpp>
+#include <fc/variant_object.hpp>
 #include <thirdparty/fc/vendor/websocketpp/websocketpp/error.hpp>
 #include <thirdparty/fc/include/fc/time.hpp>
 
+#include <atomic>
+#include <cctype>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
 namespace graphene {
     namespace plugins {
         namespace json_rpc {
@@ -24,13 +35,122 @@ namespace graphene {
                 fc::optional<fc::variant> data;
             };
 
+            /// Upper bounds of the latency histogram buckets, in microseconds
+            static const uint64_t latency_bounds_us[] = {
+                100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+                100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+            };
+
+            static const size_t latency_bucket_count = sizeof(latency_bounds_us) / sizeof(latency_bounds_us[0]);
+
+            /**
+             * Counters of one method, updated by the threads which send its responses
+             */
+            struct method_stats final {
+                method_stats() {
+                    for (auto &count : latency_counts) {
+                        count = 0;
+                    }
+                }
+
+                void record(uint64_t elapsed_us, uint64_t wait_us, size_t bytes, bool error) {
+                    ++calls;
+                    if (error) {
+                        ++errors;
+                    }
+                    response_bytes += bytes;
+                    latency_us += elapsed_us;
+                    lock_wait_us += wait_us;
+
+                    uint64_t max_wait = max_lock_wait_us;
+                    while (wait_us > max_wait && !max_lock_wait_us.compare_exchange_weak(max_wait, wait_us)) {
+                    }
+
+                    uint64_t max = max_latency_us;
+                    while (elapsed_us > max && !max_latency_us.compare_exchange_weak(max, elapsed_us)) {
+                    }
+
+                    size_t bucket = std::lower_bound(latency_bounds_us, latency_bounds_us + latency_bucket_count, elapsed_us) - latency_bounds_us;
+                    ++latency_counts[bucket];
+                }
+
+                /// Estimated by the upper bound of the bucket the percentile falls into
+                uint64_t latency_percentile(uint32_t percent) const {
+                    uint64_t counts[latency_bucket_count + 1];
+                    uint64_t total = 0;
+                    for (size_t i = 0; i <= latency_bucket_count; ++i) {
+                        counts[i] = latency_counts[i];
+                        total += counts[i];
+                    }
+
+                    uint64_t rank = (total * percent + 99) / 100;
+                    uint64_t cumulative = 0;
+                    for (size_t i = 0; i < latency_bucket_count && total; ++i) {
+                        cumulative += counts[i];
+                        if (cumulative >= rank) {
+                            return std::min<uint64_t>(latency_bounds_us[i], max_latency_us);
+                        }
+                    }
+                    return max_latency_us;
+                }
+
+                std::atomic<uint64_t> calls{0};
+                std::atomic<uint64_t> errors{0};
+                std::atomic<uint64_t> response_bytes{0};
+                std::atomic<uint64_t> latency_us{0};
+                std::atomic<uint64_t> max_latency_us{0};
+                // the part of the latency spent waiting for the database read lock
+                std::atomic<uint64_t> lock_wait_us{0};
+                std::atomic<uint64_t> max_lock_wait_us{0};
+                // the last one counts calls slower than the largest bound
+                std::atomic<uint64_t> latency_counts[latency_bucket_count + 1];
+            };
+
             struct json_rpc_response {
                 std::string jsonrpc = "2.0";
                 fc::optional<fc::variant> result;
                 fc::optional<json_rpc_error> error;
                 fc::variant id;
+                std::shared_ptr<const std::string> serialized_result;
+                method_stats *stats = nullptr;
+                fc::time_point start = fc::time_point::now();
+                uint64_t lock_wait_us = 0;
             };
 
+            static void record_stats(const json_rpc_response &response, size_t response_bytes) {
+                if (response.stats != nullptr) {
+                    response.stats->record(
+                        (fc::time_point::now() - response.start).count(), response.lock_wait_us,
+                        response_bytes, response.error.valid());
+                }
+            }
+
+            /**
+             * Writes the response without converting it into a variant, which would copy the whole result.
+             * Errors are rare, they are written by fc::json as before.
+             */
+            static std::string to_json(const json_rpc_response &response) {
+                if (response.error) {
+                    return fc::json::to_string(response);
+                }
+
+                std::string out;
+                out.reserve(128);
+                out += "{\"jsonrpc\":";
+                fast_json::write(fc::variant(response.jsonrpc), out);
+                if (response.serialized_result) {
+                    out += ",\"result\":";
+                    out += *response.serialized_result;
+                } else if (response.result) {
+                    out += ",\"result\":";
+                    fast_json::write(*response.result, out);
+                }
+                out += ",\"id\":";
+                fast_json::write(response.id, out);
+                out += '}';
+                return out;
+            }
+
             struct msg_pack::impl final {
                 using handler_type = std::function<void (json_rpc_response &)>;
 
@@ -86,6 +206,19 @@ namespace graphene {
                 return fc::optional<fc::variant>();
             }
 
+            void msg_pack::stats(method_stats *stats) {
+                // Pimpl can absent in case if msg_pack delegated its handlers to other msg_pack (see move constructor)
+                FC_ASSERT(valid(), "The msg_pack delegated its handlers");
+                pimpl->response.stats = stats;
+            }
+
+            void msg_pack::lock_wait(uint64_t microseconds) {
+                // Pimpl can absent in case if msg_pack delegated its handlers to other msg_pack (see move constructor)
+                if (valid()) {
+                    pimpl->response.lock_wait_us += microseconds;
+                }
+            }
+
             void msg_pack::unsafe_result(fc::optional<fc::variant> result) {
                 // Pimpl can absent in case if msg_pack delegated its handlers to other msg_pack (see move constructor)
                 FC_ASSERT(valid(), "The msg_pack delegated its handlers");
@@ -103,6 +236,18 @@ namespace graphene {
                 }
             }
 
+            void msg_pack::serialized_result(std::shared_ptr<const std::string> result) {
+                // Pimpl can absent in case if msg_pack delegated its handlers to other msg_pack (see move constructor)
+                FC_ASSERT(valid(), "The msg_pack delegated its handlers");
+                pimpl->response.serialized_result = std::move(result);
+                try {
+                    pimpl->handler(pimpl->response);
+                } catch (const websocketpp::exception &) {
+                    // Can't send data via socket -
+                    //    don't pass exception to upper level, because it doesn't have handler for exception
+                }
+            }
+
             fc::optional<fc::variant> msg_pack::result() const {
                 // Pimpl can absent in case if msg_pack delegated its handlers to other msg_pack (see move constructor)
                 if (valid()) {
@@ -143,6 +288,154 @@ namespace graphene {
                 return fc::optional<std::string>();
             }
 
+            /**
+             * Writes params with the keys of objects sorted, so equal params make equal cache keys
+             */
+            static void write_canonical(const fc::variant &value, std::string &out) {
+                if (value.is_object()) {
+                    const auto &object = value.get_object();
+                    std::vector<const fc::variant_object::entry *> entries;
+                    entries.reserve(object.size());
+                    for (const auto &entry : object) {
+                        entries.push_back(&entry);
+                    }
+                    std::sort(entries.begin(), entries.end(), [](const fc::variant_object::entry *a, const fc::variant_object::entry *b) {
+                        return a->key() < b->key();
+                    });
+
+                    out += '{';
+                    for (size_t i = 0; i < entries.size(); ++i) {
+                        if (i) {
+                            out += ',';
+                        }
+                        fast_json::write(fc::variant(entries[i]->key()), out);
+                        out += ':';
+                        write_canonical(entries[i]->value(), out);
+                    }
+                    out += '}';
+                } else if (value.is_array()) {
+                    const auto &array = value.get_array();
+                    out += '[';
+                    for (size_t i = 0; i < array.size(); ++i) {
+                        if (i) {
+                            out += ',';
+                        }
+                        write_canonical(array[i], out);
+                    }
+                    out += ']';
+                } else {
+                    fast_json::write(value, out);
+                }
+            }
+
+            /**
+             * Serialized results of the methods set in rpc-cache-method, keyed by their canonical params.
+             * Results are kept until the next block is applied: a result is stored only if no block
+             * was applied since the call started, so it never outlives the state it was read from.
+             */
+            class response_cache final {
+            public:
+                struct method_cache final {
+                    uint32_t max_entries = 0;
+                    std::unordered_map<std::string, std::shared_ptr<const std::string>> entries;
+                };
+
+                void add_method(const std::string &name, uint32_t max_entries) {
+                    _methods[name].max_entries = max_entries;
+                }
+
+                /// The methods are set before requests arrive, so they are read without the lock
+                method_cache *find_method(const std::string &name) {
+                    if (_methods.empty()) {
+                        return nullptr;
+                    }
+                    auto itr = _methods.find(name);
+                    return itr != _methods.end() ? &itr->second : nullptr;
+                }
+
+                std::shared_ptr<const std::string> find(const method_cache &cache, const std::string &key, uint64_t &generation) const {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    generation = _generation;
+                    auto itr = cache.entries.find(key);
+                    return itr != cache.entries.end() ? itr->second : nullptr;
+                }
+
+                void store(method_cache &cache, std::string key, std::shared_ptr<const std::string> result, uint64_t generation) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (generation == _generation && cache.entries.size() < cache.max_entries) {
+                        cache.entries.emplace(std::move(key), std::move(result));
+                    }
+                }
+
+                void clear() {
+                    if (_methods.empty()) {
+                        return;
+                    }
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    ++_generation;
+                    for (auto &method : _methods) {
+                        method.second.entries.clear();
+                    }
+                }
+
+            private:
+                std::unordered_map<std::string, method_cache> _methods;
+                uint64_t _generation = 0;
+                mutable std::mutex _mutex;
+            };
+
+            /**
+             * Methods sharing a limit of calls running at the same time, so expensive ones can't take
+             * every thread. Calls over the limit wait in a queue, calls over the queue are rejected.
+             */
+            class method_class final {
+            public:
+                enum class admission {
+                    run,
+                    queued,
+                    rejected
+                };
+
+                method_class(std::string name, uint32_t max_running, uint32_t max_queued)
+                        : name(std::move(name)), _max_running(max_running), _max_queued(max_queued) {
+                }
+
+                /// Takes the task when it's queued
+                admission admit(std::function<void()> &task) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_running < _max_running) {
+                        ++_running;
+                        return admission::run;
+                    }
+                    if (_queue.size() < _max_queued) {
+                        _queue.push_back(std::move(task));
+                        return admission::queued;
+                    }
+                    return admission::rejected;
+                }
+
+                /// Called when a call finishes, returns the queued call which takes its slot
+                std::function<void()> finish() {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_queue.empty()) {
+                        --_running;
+                        return std::function<void()>();
+                    }
+                    auto next = std::move(_queue.front());
+                    _queue.pop_front();
+                    return next;
+                }
+
+                const std::string name;
+
+            private:
+                const uint32_t _max_running;
+                const uint32_t _max_queued;
+                uint32_t _running = 0;
+                std::deque<std::function<void()>> _queue;
+                std::mutex _mutex;
+            };
+
             using get_methods_args     = void_type;
             using get_methods_return   = vector<string>;
             using get_signature_args   = string;
@@ -164,6 +457,95 @@ namespace graphene {
                     std::stringstream canonical_name;
                     canonical_name << api_name << '.' << method_name;
                     _methods.push_back(canonical_name.str());
+                    _stats[canonical_name.str()].reset(new method_stats);
+                }
+
+                method_stats *find_stats(const std::string &name) {
+                    auto itr = _stats.find(name);
+                    return itr != _stats.end() ? itr->second.get() : nullptr;
+                }
+
+                fc::variant get_stats() const {
+                    fc::mutable_variant_object result;
+                    for (const auto &item : _stats) {
+                        const method_stats &stats = *item.second;
+                        uint64_t calls = stats.calls;
+                        if (calls == 0) {
+                            continue;
+                        }
+
+                        fc::mutable_variant_object latency;
+                        latency("average", stats.latency_us / calls)
+                               ("p50", stats.latency_percentile(50))
+                               ("p90", stats.latency_percentile(90))
+                               ("p99", stats.latency_percentile(99))
+                               ("max", uint64_t(stats.max_latency_us));
+
+                        fc::mutable_variant_object lock_wait;
+                        lock_wait("average", stats.lock_wait_us / calls)
+                                 ("max", uint64_t(stats.max_lock_wait_us));
+
+                        fc::mutable_variant_object method;
+                        method("calls", calls)
+                              ("errors", uint64_t(stats.errors))
+                              ("response_bytes", uint64_t(stats.response_bytes))
+                              ("latency_us", std::move(latency))
+                              ("lock_wait_us", std::move(lock_wait));
+
+                        result(item.first, std::move(method));
+                    }
+                    return fc::variant(std::move(result));
+                }
+
+                std::string prometheus_stats() const {
+                    std::string out;
+                    out += "# HELP json_rpc_calls_total Number of responses sent by a method.\n"
+                           "# TYPE json_rpc_calls_total counter\n";
+                    for_each_called_method([&](const std::string &label, const method_stats &stats) {
+                        out += "json_rpc_calls_total" + label + ' ' + std::to_string(uint64_t(stats.calls)) + '\n';
+                    });
+
+                    out += "# HELP json_rpc_errors_total Number of errors returned by a method.\n"
+                           "# TYPE json_rpc_errors_total counter\n";
+                    for_each_called_method([&](const std::string &label, const method_stats &stats) {
+                        out += "json_rpc_errors_total" + label + ' ' + std::to_string(uint64_t(stats.errors)) + '\n';
+                    });
+
+                    out += "# HELP json_rpc_response_bytes_total Size of the responses sent by a method.\n"
+                           "# TYPE json_rpc_response_bytes_total counter\n";
+                    for_each_called_method([&](const std::string &label, const method_stats &stats) {
+                        out += "json_rpc_response_bytes_total" + label + ' ' + std::to_string(uint64_t(stats.response_bytes)) + '\n';
+                    });
+
+                    out += "# HELP json_rpc_latency_seconds Time from reading a request to sending its response.\n"
+                           "# TYPE json_rpc_latency_seconds histogram\n";
+                    for_each_called_method([&](const std::string &label, const method_stats &stats) {
+                        std::string bucket_label = label.substr(0, label.size() - 1) + ",le=\"";
+                        uint64_t cumulative = 0;
+                        for (size_t i = 0; i <= latency_bucket_count; ++i) {
+                            cumulative += stats.latency_counts[i];
+                            std::string bound = i < latency_bucket_count ? fc::to_string(latency_bounds_us[i] / 1000000.0) : "+Inf";
+                            out += "json_rpc_latency_seconds_bucket" + bucket_label + bound + "\"} " + std::to_string(cumulative) + '\n';
+                        }
+                        out += "json_rpc_latency_seconds_sum" + label + ' ' + fc::to_string(stats.latency_us / 1000000.0) + '\n';
+                        out += "json_rpc_latency_seconds_count" + label + ' ' + std::to_string(cumulative) + '\n';
+                    });
+
+                    out += "# HELP json_rpc_lock_wait_seconds_total Time a method waited for the database read lock.\n"
+                           "# TYPE json_rpc_lock_wait_seconds_total counter\n";
+                    for_each_called_method([&](const std::string &label, const method_stats &stats) {
+                        out += "json_rpc_lock_wait_seconds_total" + label + ' ' + fc::to_string(stats.lock_wait_us / 1000000.0) + '\n';
+                    });
+                    return out;
+                }
+
+                template <typename Callback>
+                void for_each_called_method(Callback &&callback) const {
+                    for (const auto &item : _stats) {
+                        if (item.second->calls != 0) {
+                            callback("{method=\"" + item.first + "\"}", *item.second);
+                        }
+                    }
                 }
 
                 api_method *find_api_method(std::string api, std::string method) {
@@ -242,36 +624,151 @@ namespace graphene {
                             return msg.error(JSON_RPC_PARSE_PARAMS_ERROR, e);
                         }
 
-                        try {
-                            auto result = (*call)(msg);
-                            if (msg.valid()) {
-                                msg.result(std::move(result));
+                        std::string method_name = msg.plugin + '.' + msg.method;
+                        msg.stats(find_stats(method_name));
+
+                        auto cached_method = _cache.find_method(method_name);
+                        std::string cache_key;
+                        uint64_t cache_generation = 0;
+                        if (cached_method != nullptr) {
+                            write_canonical(msg.args ? fc::variant(*msg.args) : fc::variant(), cache_key);
+                            auto cached_result = _cache.find(*cached_method, cache_key, cache_generation);
+                            if (cached_result) {
+                                return msg.serialized_result(std::move(cached_result));
                             }
-                        } catch (const fc::assert_exception &e) {
-                            return msg.error(JSON_RPC_ERROR_DURING_CALL, e);
                         }
+
+                        auto itr = _method_classes.find(method_name);
+                        if (itr == _method_classes.end()) {
+                            return call_api(call, msg, cached_method, std::move(cache_key), cache_generation);
+                        }
+                        call_limited(*itr->second, call, msg, cached_method, std::move(cache_key), cache_generation);
                     } else {
                         return msg.error(JSON_RPC_NO_PARAMS, "A member \"params\" does not exist");
                     }
                 }
 
+                void call_api(
+                    api_method *call, msg_pack &msg,
+                    response_cache::method_cache *cached_method, std::string cache_key, uint64_t cache_generation
+                ) {
+                    try {
+                        auto result = call_timed(call, msg);
+                        if (msg.valid()) {
+                            if (cached_method != nullptr) {
+                                auto serialized = std::make_shared<const std::string>(fast_json::to_string(result));
+                                _cache.store(*cached_method, std::move(cache_key), serialized, cache_generation);
+                                msg.serialized_result(std::move(serialized));
+                            } else {
+                                msg.result(std::move(result));
+                            }
+                        }
+                    } catch (const fc::assert_exception &e) {
+                        return msg.error(JSON_RPC_ERROR_DURING_CALL, e);
+                    }
+                }
+
+                /**
+                 * Calls the API and adds the time it waited for the database lock to its response.
+                 * The wait is summed on the calling thread, so a call delegated to another thread
+                 * reports only the part done before.
+                 */
+                static fc::variant call_timed(api_method *call, msg_pack &msg) {
+                    graphene::chain::database::reset_read_lock_wait();
+                    try {
+                        auto result = (*call)(msg);
+                        msg.lock_wait(graphene::chain::database::read_lock_wait().count());
+                        return result;
+                    } catch (...) {
+                        msg.lock_wait(graphene::chain::database::read_lock_wait().count());
+                        throw;
+                    }
+                }
+
+                /**
+                 * Runs the call when its class has a free slot, otherwise queues it. The msg is taken
+                 * over by the call, so errors after this point are answered here and not by rpc().
+                 */
+                void call_limited(
+                    method_class &limit, api_method *call, msg_pack &msg,
+                    response_cache::method_cache *cached_method, std::string cache_key, uint64_t cache_generation
+                ) {
+                    auto pending = std::make_shared<msg_pack>(std::move(msg));
+                    pending->plugin = msg.plugin;
+                    pending->method = msg.method;
+                    pending->args = std::move(msg.args);
+
+                    auto deadline = fc::time_point::now() + queue_timeout;
+                    std::function<void()> task = [this, &limit, call, pending, cached_method, cache_key, cache_generation, deadline]() {
+                        try {
+                            // only the time in the queue is limited, a started call runs until it returns
+                            if (queue_timeout.count() > 0 && fc::time_point::now() > deadline) {
+                                pending->error("Request timed out waiting for " + limit.name + " methods");
+                            } else {
+                                call_api(call, *pending, cached_method, cache_key, cache_generation);
+                            }
+                        } catch (const fc::exception &e) {
+                            if (pending->valid()) {
+                                pending->error(e);
+                            }
+                        } catch (const std::exception &e) {
+                            if (pending->valid()) {
+                                pending->error(e.what());
+                            }
+                        } catch (...) {
+                            if (pending->valid()) {
+                                pending->error("Unknown error - calling rpc method failed");
+                            }
+                        }
+
+                        // the slot goes to the next queued call
+                        auto next = limit.finish();
+                        if (next) {
+                            if (task_executor) {
+                                task_executor(std::move(next));
+                            } else {
+                                next();
+                            }
+                        }
+                    };
+
+                    switch (limit.admit(task)) {
+                        case method_class::admission::run:
+                            task();
+                            break;
+                        case method_class::admission::queued:
+                            break;
+                        case method_class::admission::rejected:
+                            pending->error("Too many " + limit.name + " requests, try again later");
+                            break;
+                    }
+                }
+
                 struct dump_rpc_time {
-                    dump_rpc_time(const fc::variant& data)
-                        : data_(data) {
+                    dump_rpc_time(const fc::variant& data, const fc::microseconds& slow_query_threshold)
+                        : data_(data), slow_query_threshold_(slow_query_threshold) {
 
-                        dlog("data: ${data}", ("data", fc::json::to_string(data_)));
+                        dlog("data: ${data}", ("data", fast_json::to_string(data_)));
                     }
 
                     ~dump_rpc_time() {
+                        auto elapsed = fc::time_point::now() - start_;
+                        if (slow_query_threshold_.count() > 0 && elapsed >= slow_query_threshold_) {
+                            wlog(
+                                "slow query: ${time} sec, data: ${data}",
+                                ("data", fast_json::to_string(data_))
+                                ("time", double(elapsed.count()) / 1000000.0));
+                        }
+
                         if (error_.empty()) {
                             dlog(
                                 "elapsed: ${time} sec, data: ${data}",
-                                ("data", fc::json::to_string(data_))
+                                ("data", fast_json::to_string(data_))
                                 ("time", double((fc::time_point::now() - start_).count()) / 1000000.0));
                         } else {
                             dlog(
                                 "elapsed: ${time} sec, error: '${error}', data: ${data}",
-                                ("data", fc::json::to_string(data_))
+                                ("data", fast_json::to_string(data_))
                                 ("error", error_)
                                 ("time", double((fc::time_point::now() - start_).count()) / 1000000.0));
                         }
@@ -285,10 +782,11 @@ namespace graphene {
                     fc::time_point start_ = fc::time_point::now();
                     std::string error_;
                     const fc::variant& data_;
+                    const fc::microseconds& slow_query_threshold_;
                 };
 
                 void rpc(const fc::variant& data, msg_pack& msg) {
-                    dump_rpc_time dump(data);
+                    dump_rpc_time dump(data, slow_query_threshold);
 
                     try {
                         rpc_jsonrpc(data.get_object(), msg);
@@ -310,29 +808,70 @@ namespace graphene {
                     }
                 }
 
-                void rpc(vector<fc::variant> messages, response_handler_type response_handler) {
-                    auto responses = std::make_shared<vector<json_rpc_response>>();
-
-                    responses->reserve(messages.size());
+                /**
+                 * Entries of a batch request. They are taken by up to batch_parallelism workers, each
+                 * response is stored in the place of its entry and the last one to complete sends them all.
+                 */
+                struct batch_call final {
+                    batch_call(vector<fc::variant> &&messages, response_handler_type &&response_handler)
+                            : messages(std::move(messages)),
+                              responses(this->messages.size()),
+                              pending_responses(this->messages.size()),
+                              response_handler(std::move(response_handler)) {
+                    }
 
-                    std::function<void()> next_handler = [response_handler, responses]{
-                        response_handler(fc::json::to_string(*responses.get()));
-                    };
+                    void complete(size_t index, json_rpc_response &response) {
+                        responses[index] = to_json(response);
+                        record_stats(response, responses[index].size());
+                        if (--pending_responses == 0) {
+                            size_t size = 2;
+                            for (const auto &r : responses) {
+                                size += r.size() + 1;
+                            }
+                            std::string result;
+                            result.reserve(size);
+                            result += '[';
+                            for (size_t i = 0; i < responses.size(); ++i) {
+                                if (i) {
+                                    result += ',';
+                                }
+                                result += responses[i];
+                            }
+                            result += ']';
+                            response_handler(result);
+                        }
+                    }
 
-                    for (auto it = messages.rbegin(); messages.rend() != it; ++it) {
-                        auto v = *it;
+                    vector<fc::variant> messages;
+                    vector<std::string> responses;
+                    std::atomic<size_t> next_message{0};
+                    std::atomic<size_t> pending_responses;
+                    response_handler_type response_handler;
+                };
 
-                        next_handler = [next_handler, responses, v, this]{
-                            msg_pack msg([next_handler, responses](json_rpc_response &response){
-                                responses->push_back(response);
-                                next_handler();
-                            });
+                void run_batch(const std::shared_ptr<batch_call> &batch) {
+                    for (size_t index = batch->next_message++; index < batch->messages.size(); index = batch->next_message++) {
+                        msg_pack msg([batch, index](json_rpc_response &response){
+                            batch->complete(index, response);
+                        });
 
-                            this->rpc(v, msg);
-                        };
+                        this->rpc(batch->messages[index], msg);
                     }
+                }
 
-                    next_handler();
+                void rpc(vector<fc::variant> messages, response_handler_type response_handler) {
+                    auto batch = std::make_shared<batch_call>(std::move(messages), std::move(response_handler));
+
+                    // the calling thread works on the batch too, the others start when the pool gets to them
+                    if (task_executor) {
+                        size_t workers = std::min<size_t>(batch->messages.size(), batch_parallelism);
+                        for (size_t i = 1; i < workers; ++i) {
+                            task_executor([this, batch]() {
+                                run_batch(batch);
+                            });
+                        }
+                    }
+                    run_batch(batch);
                 }
 
                 void initialize() {
@@ -358,6 +897,14 @@ namespace graphene {
 
                 map<string, api_description> _registered_apis;
                 vector<string> _methods;
+                task_executor_type task_executor;
+                uint32_t batch_parallelism = 8;
+                response_cache _cache;
+                fc::microseconds slow_query_threshold;
+                fc::microseconds queue_timeout;
+                std::vector<std::unique_ptr<method_class>> _limits;
+                std::unordered_map<std::string, method_class *> _method_classes;
+                std::map<std::string, std::unique_ptr<method_stats>> _stats;
                 map<string, map<string, api_method_signature> > _method_sigs;
             private:
                 // This is a reindex which allows to get parent plugin by method
@@ -375,10 +922,96 @@ namespace graphene {
             plugin::~plugin() {
             }
 
+            void plugin::set_program_options(boost::program_options::options_description &,
+                                             boost::program_options::options_description &cfg) {
+                cfg.add_options()
+                    ("rpc-batch-parallelism", boost::program_options::value<uint32_t>()->default_value(8),
+                        "Maximum number of entries of one batch request executed at the same time.")
+                    ("rpc-cache-method", boost::program_options::value<std::vector<std::string>>()->composing()->multitoken(),
+                        "Method whose responses are kept until the next block, as api.method or api.method=N, "
+                        "where N is how many different params are kept (16 by default). "
+                        "Only for methods which return the same result for the same params within a block.")
+                    ("rpc-slow-query-threshold-ms", boost::program_options::value<uint32_t>()->default_value(0),
+                        "Log requests which take longer than this, with their params. 0 disables the log.")
+                    ("rpc-method-class", boost::program_options::value<std::vector<std::string>>()->composing()->multitoken(),
+                        "Methods sharing a limit of calls running at the same time, as name:running:queued:api.method,api.method... "
+                        "Calls over the limit wait in a queue of the given size, calls over the queue are rejected.")
+                    ("rpc-queue-timeout-ms", boost::program_options::value<uint32_t>()->default_value(0),
+                        "Reject calls which waited in the queue of their method class longer than this. 0 disables the timeout. "
+                        "The timeout is checked only when a call leaves the queue, a call which already runs is never cut off.");
+            }
+
+            /// Parses a number of an option value, returns false if the value isn't a valid uint32_t
+            static bool parse_option_number(const std::string &value, uint32_t &result) {
+                if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0]))) {
+                    return false;
+                }
+                try {
+                    size_t parsed_length = 0;
+                    unsigned long number = std::stoul(value, &parsed_length);
+                    if (parsed_length != value.size() || number > std::numeric_limits<uint32_t>::max()) {
+                        return false;
+                    }
+                    result = static_cast<uint32_t>(number);
+                    return true;
+                } catch (const std::exception &) {
+                    return false;
+                }
+            }
+
             void plugin::plugin_initialize(const boost::program_options::variables_map &options) {
                 ilog("json_rpc plugin: plugin_initialize() begin");
                 pimpl = std::make_unique<impl>();
                 pimpl->initialize();
+                pimpl->batch_parallelism = options.at("rpc-batch-parallelism").as<uint32_t>();
+                FC_ASSERT(pimpl->batch_parallelism > 0, "rpc-batch-parallelism must be greater than 0");
+                pimpl->slow_query_threshold = fc::milliseconds(options.at("rpc-slow-query-threshold-ms").as<uint32_t>());
+                pimpl->queue_timeout = fc::milliseconds(options.at("rpc-queue-timeout-ms").as<uint32_t>());
+
+                if (options.count("rpc-method-class")) {
+                    for (const auto &definition : options.at("rpc-method-class").as<std::vector<std::string>>()) {
+                        std::vector<std::string> parts;
+                        boost::split(parts, definition, boost::is_any_of(":"));
+                        FC_ASSERT(parts.size() == 4,
+                                  "Invalid rpc-method-class ${class}, should be name:running:queued:api.method,api.method...",
+                                  ("class", definition));
+
+                        uint32_t max_running = 0;
+                        uint32_t max_queued = 0;
+                        FC_ASSERT(parse_option_number(parts[1], max_running) && parse_option_number(parts[2], max_queued),
+                                  "Invalid rpc-method-class ${class}, running and queued must be numbers", ("class", definition));
+                        FC_ASSERT(max_running > 0, "Invalid rpc-method-class ${class}, running must be greater than 0", ("class", definition));
+
+                        pimpl->_limits.emplace_back(new method_class(parts[0], max_running, max_queued));
+                        std::vector<std::string> methods;
+                        boost::split(methods, parts[3], boost::is_any_of(","));
+                        for (const auto &method : methods) {
+                            FC_ASSERT(pimpl->_method_classes.emplace(method, pimpl->_limits.back().get()).second,
+                                      "Method ${method} is in more than one rpc-method-class", ("method", method));
+                        }
+                        ilog("json_rpc plugin: ${name} methods run ${running} at a time: ${methods}",
+                             ("name", parts[0])("running", max_running)("methods", parts[3]));
+                    }
+                }
+
+                if (options.count("rpc-cache-method")) {
+                    for (const auto &policy : options.at("rpc-cache-method").as<std::vector<std::string>>()) {
+                        std::vector<std::string> parts;
+                        boost::split(parts, policy, boost::is_any_of("="));
+                        FC_ASSERT(parts.size() <= 2 && parts[0].find('.') != std::string::npos,
+                                  "Invalid rpc-cache-method ${policy}, should be api.method or api.method=N", ("policy", policy));
+
+                        uint32_t max_entries = 16;
+                        FC_ASSERT(parts.size() == 1 || parse_option_number(parts[1], max_entries),
+                                  "Invalid rpc-cache-method ${policy}, N must be a number", ("policy", policy));
+                        FC_ASSERT(max_entries > 0, "Invalid rpc-cache-method ${policy}, N must be greater than 0", ("policy", policy));
+                        pimpl->_cache.add_method(parts[0], max_entries);
+                        ilog("json_rpc plugin: caching responses of ${method}", ("method", parts[0]));
+                    }
+                }
+                add_api_method("json_rpc", "get_stats", [this](msg_pack &) {
+                    return pimpl->get_stats();
+                });
                 ilog("json_rpc plugin: plugin_initialize() end");
             }
 
@@ -399,18 +1032,35 @@ namespace graphene {
                 pimpl->add_api_method(api_name, method_name, api/*, sig*/ );
             }
 
-            void plugin::call(const string &message, response_handler_type response_handler) {
+            void plugin::clear_cache() {
+                pimpl->_cache.clear();
+            }
+
+            std::string plugin::prometheus_stats() const {
+                return pimpl->prometheus_stats();
+            }
+
+            void plugin::set_task_executor(task_executor_type executor) {
+                pimpl->task_executor = std::move(executor);
+            }
+
+            void plugin::call(const string &message, response_handler_type response_handler, batch_admission_type admission) {
                 try {
-                    fc::variant v = fc::json::from_string(message);
+                    fc::variant v = fast_json::from_string(message);
 
                     if (v.is_array()) {
                         vector<fc::variant> messages = v.as<vector<fc::variant>>();
 
                         FC_ASSERT(messages.size(), "Array is invalid");
+                        if (admission && !admission(messages.size())) {
+                            return reject("Too many requests, try again later", std::move(response_handler));
+                        }
                         pimpl->rpc(messages, response_handler);
                     } else {
                         msg_pack msg([response_handler](json_rpc_response &response){
-                            response_handler(fc::json::to_string(response));
+                            auto json = to_json(response);
+                            record_stats(response, json.size());
+                            response_handler(json);
                         });
 
                         pimpl->rpc(v, msg);
@@ -421,6 +1071,13 @@ namespace graphene {
                     response_handler(fc::json::to_string(response));
                 }
             }
+
+            void plugin::reject(const string &message, response_handler_type response_handler) {
+                // the body isn't parsed, a rejected client mustn't cost more than the reply
+                json_rpc_response response;
+                response.error = json_rpc_error(JSON_RPC_SERVER_ERROR, message);
+                response_handler(to_json(response));
+            }
         }
     }
 } // graphene::plugins::json_rpc
@@ -2,13 +2,22 @@
 
 #include <graphene/network/node.hpp>
 #include <graphene/network/exceptions.hpp>
+#include <graphene/network/message_oriented_connection.hpp>
 
 #include <graphene/chain/database_exceptions.hpp>
+#include <graphene/chain/witness_objects.hpp>
 
 #include <fc/network/resolve.hpp>
 
 #include <boost/range/algorithm/reverse.hpp>
 #include <boost/range/adaptor/reversed.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/member.hpp>
 
 using std::string;
 using std::vector;
@@ -34,10 +43,38 @@ namespace graphene {
 
             namespace detail {
 
+                /**
+                 * Block message ready to be sent to peers, kept so that blocks requested by many
+                 * syncing peers are read and encoded only once
+                 */
+                struct block_message_cache_entry {
+                    block_id_type block_id;
+                    block_id_type previous;
+                    uint32_t block_num = 0;
+                    bool irreversible = false; ///< read from the block log, so it is on the main chain
+                    message encoded_message;
+                };
+
+                struct by_block_id;
+                struct by_block_num;
+
+                typedef boost::multi_index_container<
+                    block_message_cache_entry,
+                    boost::multi_index::indexed_by<
+                        boost::multi_index::sequenced<>,
+                        boost::multi_index::hashed_unique<
+                            boost::multi_index::tag<by_block_id>,
+                            boost::multi_index::member<block_message_cache_entry, block_id_type, &block_message_cache_entry::block_id>,
+                            std::hash<fc::ripemd160>>,
+                        boost::multi_index::hashed_non_unique<
+                            boost::multi_index::tag<by_block_num>,
+                            boost::multi_index::member<block_message_cache_entry, uint32_t, &block_message_cache_entry::block_num>>>
+                > block_message_cache_type;
+
                 class p2p_plugin_impl : public graphene::network::node_delegate {
                 public:
 
-                    p2p_plugin_impl(chain::plugin &c) : chain(c) {
+                    p2p_plugin_impl(chain::plugin &c) : chain(c), signature_work(signature_ios) {
                     }
 
                     virtual ~p2p_plugin_impl() {
@@ -52,6 +89,10 @@ namespace graphene {
 
                     virtual bool handle_block(const block_message &, bool, std::vector<fc::uint160_t> &) override;
 
+                    virtual void prevalidate_sync_blocks(const std::vector<signed_block_header> &) override;
+
+                    virtual void prevalidate_block_for_relay(const block_message &) override;
+
                     virtual void handle_transaction(const trx_message &) override;
 
                     virtual void handle_message(const message &) override;
@@ -61,6 +102,8 @@ namespace graphene {
 
                     virtual message get_item(const item_id &) override;
 
+                    virtual std::vector<message> get_block_range(const item_hash_t &, uint32_t) override;
+
                     virtual std::vector<item_hash_t> get_blockchain_synopsis(const item_hash_t &, uint32_t) override;
 
                     virtual void sync_status(uint32_t, uint32_t) override;
@@ -79,6 +122,12 @@ namespace graphene {
 
                     virtual void error_encountered(const std::string &message, const fc::oexception &error) override;
 
+                    const block_message_cache_entry *find_block_message(const block_id_type &block_id);
+
+                    const block_message_cache_entry *read_block_message(uint32_t block_num);
+
+                    const block_message_cache_entry &cache_block_message(block_message_cache_entry &&entry);
+
                     //virtual uint8_t get_current_block_interval_in_seconds() const override {
                     //    return CHAIN_BLOCK_INTERVAL;
                     //}
@@ -90,12 +139,21 @@ namespace graphene {
                     uint32_t max_connections = 0;
                     bool force_validate = false;
                     bool block_producer = false;
+                    bool header_first_relay = false;
 
                     std::unique_ptr<graphene::network::node> node;
 
                     chain::plugin &chain;
 
                     fc::thread p2p_thread;
+
+                    uint32_t sync_signature_threads = 0;
+                    uint32_t decode_threads = 0;
+                    uint32_t block_message_cache_size = 0;
+                    block_message_cache_type block_message_cache;
+                    boost::asio::io_service signature_ios;
+                    boost::asio::io_service::work signature_work;
+                    boost::thread_group signature_thread_pool;
                 };
 
                 ////////////////////////////// Begin node_delegate Implementation //////////////////////////////
@@ -159,9 +217,87 @@ namespace graphene {
                     } FC_CAPTURE_AND_RETHROW((blk_msg)(sync_mode))
                 }
 
+                void p2p_plugin_impl::prevalidate_sync_blocks(const std::vector<signed_block_header> &headers) {
+                    if (!sync_signature_threads) {
+                        return;
+                    }
+
+                    // the pool completes fc promises, so waiting for them yields this fiber and the p2p thread
+                    // keeps handling messages of other peers meanwhile
+                    std::vector<fc::future<void>> results;
+                    results.reserve(headers.size());
+                    for (const auto &header : headers) {
+                        fc::promise<void>::ptr done(new fc::promise<void>("p2p_plugin::prevalidate_sync_blocks"));
+                        results.emplace_back(done);
+                        // the task owns its header, the waiting fiber can be canceled before the pool gets to it
+                        signature_ios.post([this, header, done]() {
+                            try {
+                                chain.db().prevalidate_block_signee(header);
+                                done->set_value();
+                            } catch (const fc::exception &e) {
+                                done->set_exception(e.dynamic_copy_exception());
+                            } catch (...) {
+                                done->set_exception(fc::exception_ptr(new fc::unhandled_exception(
+                                        FC_LOG_MESSAGE(warn, "block signee prevalidation failed"), std::current_exception())));
+                            }
+                        });
+                    }
+
+                    for (size_t i = 0; i < results.size(); ++i) {
+                        try {
+                            results[i].wait();
+                        } catch (const fc::canceled_exception &) {
+                            throw;
+                        } catch (const fc::exception &e) {
+                            // the block will be rejected when it is pushed
+                            fc_wlog(fc::logger::get("sync"), "sync block #${block_num} has invalid witness signature: ${e}",
+                                    ("block_num", headers[i].block_num())("e", e.to_detail_string()));
+                        }
+                    }
+                }
+
+                void p2p_plugin_impl::prevalidate_block_for_relay(const block_message &blk_msg) {
+                    try {
+                        const auto &block = blk_msg.block;
+                        chain.check_time_in_block(block);
+                        // the signee is cached, so pushing the block doesn't recover it again
+                        auto signee = chain.db().prevalidate_block_signee(block);
+
+                        chain.db().with_weak_read_lock([&]() {
+                            auto &db = chain.db();
+                            FC_ASSERT(block.previous == db.head_block_id(),
+                                      "Block doesn't link to the head block");
+                            uint32_t slot_num = db.get_slot_at_time(block.timestamp);
+                            FC_ASSERT(slot_num > 0, "Block timestamp is not in a future slot");
+                            FC_ASSERT(db.get_scheduled_witness(slot_num) == block.witness,
+                                      "Witness produced block at wrong time",
+                                      ("block witness", block.witness)("scheduled", db.get_scheduled_witness(slot_num))("slot_num", slot_num));
+                            FC_ASSERT(db.get_witness(block.witness).signing_key == signee,
+                                      "Block is signed by wrong key", ("witness", block.witness)("signee", signee));
+                        });
+                    } FC_CAPTURE_AND_RETHROW((blk_msg.block_id))
+                }
+
                 void p2p_plugin_impl::handle_transaction(const trx_message &trx_msg) {
                     try {
-                        chain.accept_transaction(trx_msg.trx);
+                        // only this fiber waits for the admission, transactions from other peers are
+                        // received meanwhile and validated and pushed along with this one
+                        fc::promise<void>::ptr accepted(new fc::promise<void>("p2p_plugin::handle_transaction"));
+                        chain.accept_transaction_async(trx_msg.trx, [accepted](std::exception_ptr error) {
+                            if (!error) {
+                                accepted->set_value();
+                                return;
+                            }
+                            try {
+                                std::rethrow_exception(error);
+                            } catch (const fc::exception &e) {
+                                accepted->set_exception(e.dynamic_copy_exception());
+                            } catch (...) {
+                                accepted->set_exception(fc::exception_ptr(new fc::unhandled_exception(
+                                        FC_LOG_MESSAGE(warn, "transaction rejected"), std::current_exception())));
+                            }
+                        });
+                        fc::future<void>(accepted).wait();
                     } FC_CAPTURE_AND_RETHROW((trx_msg))
                 }
 
@@ -226,19 +362,107 @@ namespace graphene {
                     } FC_CAPTURE_AND_RETHROW((blockchain_synopsis)(remaining_item_count)(limit))
                 }
 
+                static block_message_cache_entry make_block_message_cache_entry(const signed_block &block) {
+                    block_message_cache_entry entry;
+                    block_message msg(block);
+                    entry.block_id = msg.block_id;
+                    entry.previous = block.previous;
+                    entry.block_num = block.block_num();
+                    entry.encoded_message = message(msg);
+                    return entry;
+                }
+
+                const block_message_cache_entry *p2p_plugin_impl::find_block_message(const block_id_type &block_id) {
+                    auto &by_id = block_message_cache.get<by_block_id>();
+                    auto itr = by_id.find(block_id);
+                    if (itr == by_id.end()) {
+                        return nullptr;
+                    }
+                    block_message_cache.relocate(block_message_cache.begin(), block_message_cache.project<0>(itr));
+                    return &*itr;
+                }
+
+                const block_message_cache_entry *p2p_plugin_impl::read_block_message(uint32_t block_num) {
+                    auto range = block_message_cache.get<by_block_num>().equal_range(block_num);
+                    for (auto itr = range.first; itr != range.second; ++itr) {
+                        if (itr->irreversible) {
+                            block_message_cache.relocate(block_message_cache.begin(), block_message_cache.project<0>(itr));
+                            return &*itr;
+                        }
+                    }
+
+                    // the block log has its own lock, so this doesn't wait for the database
+                    auto data = chain.db().get_block_log().read_raw_block_by_num(block_num);
+                    if (data.empty()) {
+                        return nullptr;
+                    }
+
+                    // only the header is unpacked to get the block id, the transactions stay as they are
+                    signed_block_header header;
+                    fc::datastream<const char *> ds(data.data(), data.size());
+                    fc::raw::unpack(ds, header);
+
+                    block_message_cache_entry entry;
+                    entry.block_id = header.id();
+                    entry.previous = header.previous;
+                    entry.block_num = block_num;
+                    entry.irreversible = true;
+
+                    // a packed block_message is the packed block followed by its id
+                    auto packed_id = fc::raw::pack(entry.block_id);
+                    data.insert(data.end(), packed_id.begin(), packed_id.end());
+                    entry.encoded_message.msg_type = block_message::type;
+                    entry.encoded_message.size = (uint32_t)data.size();
+                    entry.encoded_message.data = std::move(data);
+
+                    return &cache_block_message(std::move(entry));
+                }
+
+                const block_message_cache_entry &p2p_plugin_impl::cache_block_message(block_message_cache_entry &&entry) {
+                    auto &by_id = block_message_cache.get<by_block_id>();
+                    auto itr = by_id.find(entry.block_id);
+                    if (itr != by_id.end()) {
+                        if (entry.irreversible && !itr->irreversible) {
+                            by_id.modify(itr, [](block_message_cache_entry &e) {
+                                e.irreversible = true;
+                            });
+                        }
+                        block_message_cache.relocate(block_message_cache.begin(), block_message_cache.project<0>(itr));
+                        return *itr;
+                    }
+
+                    block_message_cache.push_front(std::move(entry));
+                    while (block_message_cache.size() > std::max<uint32_t>(block_message_cache_size, 1)) {
+                        block_message_cache.pop_back();
+                    }
+                    return block_message_cache.front();
+                }
+
                 message p2p_plugin_impl::get_item(const item_id &id) {
                     try {
                         if (id.item_type == network::block_message_type) {
-                            return chain.db().with_weak_read_lock([&]() {
-                                auto opt_block = chain.db().fetch_block_by_id(id.item_hash);
-                                if (!opt_block)
-                                    elog("Couldn't find block ${id} -- corresponding ID in our chain is ${id2}",
-                                         ("id", id.item_hash)("id2", chain.db().get_block_id_for_num(
-                                                 block_header::num_from_id(id.item_hash))));
+                            const block_message_cache_entry *entry = find_block_message(id.item_hash);
+                            if (entry == nullptr) {
+                                entry = read_block_message(block_header::num_from_id(id.item_hash));
+                                if (entry != nullptr && entry->block_id != id.item_hash) {
+                                    entry = nullptr;
+                                }
+                            }
+                            if (entry == nullptr) {
+                                // reversible blocks are only in the fork database
+                                auto opt_block = chain.db().with_weak_read_lock([&]() {
+                                    auto opt_block = chain.db().fetch_block_by_id(id.item_hash);
+                                    if (!opt_block)
+                                        elog("Couldn't find block ${id} -- corresponding ID in our chain is ${id2}",
+                                             ("id", id.item_hash)("id2", chain.db().get_block_id_for_num(
+                                                     block_header::num_from_id(id.item_hash))));
+                                    return opt_block;
+                                });
                                 FC_ASSERT(opt_block.valid());
                                 // ilog("Serving up block #${num}", ("num", opt_block->block_num()));
-                                return block_message(std::move(*opt_block));
-                            });
+                                entry = &cache_block_message(make_block_message_cache_entry(*opt_block));
+                            }
+                            return entry->encoded_message;
                         }
                         return chain.db().with_weak_read_lock([&]() {
                             return trx_message(chain.db().get_recent_transaction(id.item_hash));
@@ -246,6 +470,59 @@ namespace graphene {
                     } FC_CAPTURE_AND_RETHROW((id))
                 }
 
+                std::vector<message> p2p_plugin_impl::get_block_range(const item_hash_t &first_block, uint32_t count) {
+                    try {
+                        std::vector<message> result;
+                        uint32_t block_num = block_header::num_from_id(first_block);
+                        block_id_type previous_id;
+
+                        // irreversible blocks are on the main chain, serve them from the block log
+                        for (; result.size() < count; ++block_num) {
+                            const block_message_cache_entry *entry = read_block_message(block_num);
+                            if (entry == nullptr) {
+                                break;
+                            }
+                            if (result.empty() ? entry->block_id != first_block : entry->previous != previous_id) {
+                                return result;
+                            }
+                            previous_id = entry->block_id;
+                            result.push_back(entry->encoded_message);
+                        }
+                        if (result.size() == count) {
+                            return result;
+                        }
+
+                        std::vector<signed_block> blocks;
+                        chain.db().with_weak_read_lock([&]() {
+                            uint32_t head_block_num = chain.db().head_block_num();
+                            if (result.empty()) {
+                                auto opt_block = chain.db().fetch_block_by_id(first_block);
+                                // only serve ranges on our main chain, blocks following a fork block are not its successors
+                                if (!opt_block || block_num > head_block_num ||
+                                    chain.db().get_block_id_for_num(block_num) != first_block) {
+                                    return;
+                                }
+                                blocks.push_back(std::move(*opt_block));
+                                previous_id = first_block;
+                                ++block_num;
+                            }
+                            for (; result.size() + blocks.size() < count && block_num <= head_block_num; ++block_num) {
+                                auto opt_block = chain.db().fetch_block_by_number(block_num);
+                                if (!opt_block || opt_block->previous != previous_id) {
+                                    break;
+                                }
+                                previous_id = opt_block->id();
+                                blocks.push_back(std::move(*opt_block));
+                            }
+                        });
+
+                        for (const signed_block &block : blocks) {
+                            result.push_back(cache_block_message(make_block_message_cache_entry(block)).encoded_message);
+                        }
+                        return result;
+                    } FC_CAPTURE_AND_RETHROW((first_block)(count))
+                }
+
                 chain_id_type p2p_plugin_impl::get_chain_id() const {
                     return CHAIN_ID;
                 }
@@ -443,7 +720,15 @@ namespace graphene {
                     ("seed-node", boost::program_options::value<vector<string>>()->composing(),
                         "The IP address and port of a remote peer to sync with. Deprecated in favor of p2p-seed-node.")
                     ("p2p-seed-node", boost::program_options::value<vector<string>>()->composing(),
-                        "The IP address and port of a remote peer to sync with.");
+                        "The IP address and port of a remote peer to sync with.")
+                    ("p2p-sync-signature-threads", boost::program_options::value<uint32_t>()->default_value(2),
+                        "Number of threads to check witness signatures of received sync blocks in parallel (0 to check them on push).")
+                    ("p2p-decode-threads", boost::program_options::value<uint32_t>()->default_value(2),
+                        "Number of threads to decrypt and unpack large P2P messages (0 to do it on the P2P thread).")
+                    ("p2p-block-message-cache-size", boost::program_options::value<uint32_t>()->default_value(1000),
+                        "Number of encoded blocks kept to serve them to syncing peers without reading them again.")
+                    ("p2p-header-first-relay", boost::program_options::value<bool>()->default_value(false),
+                        "Relay a block to peers as soon as its header and witness signature are checked, before applying it.");
                 cli.add_options()
                     ("force-validate", boost::program_options::bool_switch()->default_value(false),
                         "Force validation of all transactions. Deprecated in favor of p2p-force-validate")
@@ -496,9 +781,20 @@ namespace graphene {
                     wlog("Option force-validate is deprecated in favor of p2p-force-validate");
                     my->force_validate = true;
                 }
+
+                my->sync_signature_threads = options.at("p2p-sync-signature-threads").as<uint32_t>();
+                my->decode_threads = options.at("p2p-decode-threads").as<uint32_t>();
+                my->block_message_cache_size = options.at("p2p-block-message-cache-size").as<uint32_t>();
+                my->header_first_relay = options.at("p2p-header-first-relay").as<bool>();
             }
 
             void p2p_plugin::plugin_startup() {
+                for (uint32_t i = 0; i < my->sync_signature_threads; ++i) {
+                    my->signature_thread_pool.create_thread(boost::bind(&boost::asio::io_service::run, &my->signature_ios));
+                }
+
+                graphene::network::message_oriented_connection::set_decode_thread_count(my->decode_threads);
+
                 my->p2p_thread.async([this] {
                     my->node.reset(new graphene::network::node(my->user_agent));
                     my->node->load_configuration(app().data_dir() / "p2p");
@@ -522,6 +818,12 @@ namespace graphene {
                         my->node->set_advanced_node_parameters(node_param);
                     }
 
+                    if (my->header_first_relay) {
+                        ilog("Relaying blocks before applying them");
+                        my->node->set_advanced_node_parameters(
+                                fc::variant_object("header_first_relay", fc::variant(true)));
+                    }
+
                     my->node->listen_to_p2p_network();
                     my->node->connect_to_p2p_network();
                     block_id_type block_id;
@@ -540,6 +842,9 @@ namespace graphene {
                 my->node->close();
                 my->p2p_thread.quit();
                 my->node.reset();
+                my->signature_ios.stop();
+                my->signature_thread_pool.join_all();
+                graphene::network::message_oriented_connection::set_decode_thread_count(0);
             }
 
             void p2p_plugin::broadcast_block(const protocol::signed_block &block) {
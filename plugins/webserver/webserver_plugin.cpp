@@ -22,6 +22,11 @@
 
 #include <thread>
 #include <memory>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <list>
 #include <iostream>
 #include <graphene/plugins/json_rpc/plugin.hpp>
 
@@ -76,6 +81,63 @@ namespace graphene {
 
             using websocket_server_type = websocketpp::server<asio_with_stub_log>;
 
+            /**
+             * Token bucket of each client: a request takes a token per call, tokens come back at rate per second
+             * up to burst, so a client can't send more than that however many connections it opens.
+             * Only the max_clients most recently seen clients are kept, the others start with a full bucket.
+             */
+            class rate_limiter final {
+            public:
+                rate_limiter(double rate, double burst)
+                        : _rate(rate), _burst(burst) {
+                }
+
+                bool allow(const string &client, double tokens = 1) {
+                    auto now = std::chrono::steady_clock::now();
+                    std::lock_guard<std::mutex> lock(_mutex);
+
+                    auto itr = _buckets.find(client);
+                    if (itr != _buckets.end()) {
+                        _recent_clients.splice(_recent_clients.begin(), _recent_clients, itr->second);
+                    } else {
+                        if (_buckets.size() >= max_clients) {
+                            _buckets.erase(_recent_clients.back().client);
+                            _recent_clients.pop_back();
+                        }
+                        _recent_clients.push_front(bucket{client, _burst, now});
+                        _buckets.emplace(client, _recent_clients.begin());
+                    }
+
+                    bucket &b = _recent_clients.front();
+                    b.tokens = std::min(_burst, b.tokens + elapsed_seconds(b.updated, now) * _rate);
+                    b.updated = now;
+                    if (b.tokens < tokens) {
+                        return false;
+                    }
+                    b.tokens -= tokens;
+                    return true;
+                }
+
+            private:
+                struct bucket {
+                    string client;
+                    double tokens;
+                    std::chrono::steady_clock::time_point updated;
+                };
+
+                static const size_t max_clients = 100000;
+
+                static double elapsed_seconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+                    return std::chrono::duration<double>(to - from).count();
+                }
+
+                const double _rate;
+                const double _burst;
+                std::list<bucket> _recent_clients; /// the most recently seen first
+                std::unordered_map<string, std::list<bucket>::iterator> _buckets;
+                std::mutex _mutex;
+            };
+
             struct webserver_plugin::webserver_plugin_impl final {
             public:
                 boost::thread_group& thread_pool = appbase::app().scheduler();
@@ -93,6 +155,10 @@ namespace graphene {
 
                 void handle_http_message(websocket_server_type *, connection_hdl);
 
+                string rate_limit_client(websocket_server_type::connection_ptr);
+
+                plugins::json_rpc::plugin::batch_admission_type batch_admission(const string &client);
+
                 shared_ptr<std::thread> http_thread;
                 asio::io_service http_ios;
                 optional<tcp::endpoint> http_endpoint;
@@ -106,6 +172,10 @@ namespace graphene {
                 asio::io_service::work thread_pool_work;
 
                 plugins::json_rpc::plugin *api;
+                string metrics_path;
+                std::unique_ptr<rate_limiter> limiter;
+                string rate_limit_key_header;
+                std::unordered_set<string> rate_limit_api_keys;
                 boost::signals2::connection chain_sync_con;
             };
 
@@ -195,7 +265,15 @@ namespace graphene {
                 websocket_server_type::message_ptr msg
             ) {
                 auto con = server->get_con_from_hdl(hdl);
-                thread_pool_ios.post([con, msg, this]() {
+                auto client = rate_limit_client(con);
+                if (!client.empty() && !limiter->allow(client)) {
+                    api->reject("Too many requests, try again later", [con](const std::string &data) {
+                        con->send(data);
+                    });
+                    return;
+                }
+
+                thread_pool_ios.post([con, msg, client, this]() {
                     try {
                         if (msg->get_opcode() == websocketpp::frame::opcode::text) {
                             api->call(msg->get_payload(), [con](const std::string &data){
@@ -203,7 +281,7 @@ namespace graphene {
                                 if (ec) {
                                     throw websocketpp::exception(ec);
                                 }
-                            });
+                            }, batch_admission(client));
                         } else {
                             con->send("error: string payload expected");
                         }
@@ -215,9 +293,29 @@ namespace graphene {
 
             void webserver_plugin::webserver_plugin_impl::handle_http_message(websocket_server_type *server, connection_hdl hdl) {
                 auto con = server->get_con_from_hdl(hdl);
+                auto client = rate_limit_client(con);
+                if (!client.empty() && !limiter->allow(client)) {
+                    con->set_body("Too many requests");
+                    con->set_status(websocketpp::http::status_code::too_many_requests);
+                    return;
+                }
+
                 con->defer_http_response();
 
-                thread_pool_ios.post([con, this]() {
+                thread_pool_ios.post([con, client, this]() {
+                    if (!metrics_path.empty() && con->get_request().get_method() == "GET" &&
+                        con->get_resource().substr(0, con->get_resource().find('?')) == metrics_path) {
+                        con->append_header("Content-Type", "text/plain; version=0.0.4");
+                        con->set_body(api->prometheus_stats());
+                        con->set_status(websocketpp::http::status_code::ok);
+                        try {
+                            con->send_http_response();
+                        } catch (...) {
+                            // disable segfault
+                        }
+                        return;
+                    }
+
                     auto body = con->get_request_body();
 
                     try {
@@ -227,7 +325,7 @@ namespace graphene {
                             con->set_body(data);
                             con->set_status(websocketpp::http::status_code::ok);
                             con->send_http_response();
-                        });
+                        }, batch_admission(client));
                     } catch (fc::exception &e) {
                         // this case happens if exception was thrown on parsing request
                         edump((e));
@@ -245,6 +343,41 @@ namespace graphene {
                 });
             }
 
+            /**
+             * Returns the name of the bucket the request is counted against: its API key when it sends
+             * a configured one, otherwise its address. Empty when the request isn't limited.
+             */
+            string webserver_plugin::webserver_plugin_impl::rate_limit_client(websocket_server_type::connection_ptr con) {
+                if (!limiter) {
+                    return string();
+                }
+
+                if (!rate_limit_key_header.empty()) {
+                    const auto &key = con->get_request_header(rate_limit_key_header);
+                    // unknown keys would let a client get a new bucket with every request
+                    if (!key.empty() && rate_limit_api_keys.count(key)) {
+                        return "key " + key;
+                    }
+                }
+
+                boost::system::error_code ec;
+                auto endpoint = con->get_raw_socket().remote_endpoint(ec);
+                if (ec) {
+                    return string();
+                }
+                return endpoint.address().to_string();
+            }
+
+            /// The request has taken one token already, each further entry of a batch takes one more
+            plugins::json_rpc::plugin::batch_admission_type webserver_plugin::webserver_plugin_impl::batch_admission(const string &client) {
+                if (client.empty()) {
+                    return plugins::json_rpc::plugin::batch_admission_type();
+                }
+                return [this, client](size_t entries) {
+                    return limiter->allow(client, double(entries - 1));
+                };
+            }
+
             webserver_plugin::webserver_plugin() {
             }
 
@@ -260,7 +393,17 @@ namespace graphene {
                     ("rpc-endpoint", boost::program_options::value<string>(),
                         "Local http and websocket endpoint for webserver requests. Deprectaed in favor of webserver-http-endpoint and webserver-ws-endpoint")
                     ("webserver-thread-pool-size", boost::program_options::value<thread_pool_size_t>()->default_value(256),
-                        "Number of threads used to handle queries. Default: 256.");
+                        "Number of threads used to handle queries. Default: 256.")
+                    ("webserver-metrics-path", boost::program_options::value<string>()->default_value(""),
+                        "Path of the http endpoint which serves RPC stats in Prometheus format, e.g. /metrics. Disabled when empty.")
+                    ("webserver-rate-limit", boost::program_options::value<double>()->default_value(0),
+                        "Requests per second each client can send, over http and websocket together, each entry of a batch counts as a request. 0 disables the limit.")
+                    ("webserver-rate-limit-burst", boost::program_options::value<double>()->default_value(100),
+                        "Requests a client can send at once after being idle, when webserver-rate-limit is set. Larger batches are always rejected.")
+                    ("webserver-rate-limit-key-header", boost::program_options::value<string>()->default_value(""),
+                        "Http header with the API key of a client, e.g. X-Api-Key. Clients sending a key listed in webserver-rate-limit-api-key are limited by the key instead of their address.")
+                    ("webserver-rate-limit-api-key", boost::program_options::value<std::vector<string>>()->composing()->multitoken(),
+                        "API key which gets its own rate limit, when sent in webserver-rate-limit-key-header. Can be specified multiple times.");
             }
 
             void webserver_plugin::plugin_initialize(const boost::program_options::variables_map &options) {
@@ -268,6 +411,21 @@ namespace graphene {
                 FC_ASSERT(thread_pool_size > 0, "webserver-thread-pool-size must be greater than 0");
                 ilog("configured with ${tps} thread pool size", ("tps", thread_pool_size));
                 my.reset(new webserver_plugin_impl(thread_pool_size));
+                my->metrics_path = options.at("webserver-metrics-path").as<string>();
+
+                auto rate_limit = options.at("webserver-rate-limit").as<double>();
+                if (rate_limit > 0) {
+                    auto burst = options.at("webserver-rate-limit-burst").as<double>();
+                    FC_ASSERT(burst >= 1, "webserver-rate-limit-burst must be at least 1");
+                    my->limiter.reset(new rate_limiter(rate_limit, burst));
+                    my->rate_limit_key_header = options.at("webserver-rate-limit-key-header").as<string>();
+                    if (options.count("webserver-rate-limit-api-key")) {
+                        for (const auto &key : options.at("webserver-rate-limit-api-key").as<std::vector<string>>()) {
+                            my->rate_limit_api_keys.insert(key);
+                        }
+                    }
+                    ilog("configured rate limit of ${rate} requests per second per client", ("rate", rate_limit));
+                }
 
                 if (options.count("webserver-http-endpoint")) {
                     auto http_endpoint = options.at("webserver-http-endpoint").as<string>();
@@ -314,6 +472,9 @@ namespace graphene {
             void webserver_plugin::plugin_startup() {
                 my->api = appbase::app().find_plugin<plugins::json_rpc::plugin>();
                 FC_ASSERT(my->api != nullptr, "Could not find API Register Plugin");
+                my->api->set_task_executor([this](std::function<void()> task) {
+                    my->thread_pool_ios.post(std::move(task));
+                });
 
                 chain::plugin *chain = appbase::app().find_plugin<chain::plugin>();
                 if (chain != nullptr && chain->get_state() != appbase::abstract_plugin::started) {
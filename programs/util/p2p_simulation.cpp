@@ -0,0 +1,478 @@
+/**
+ * Runs a network of in-process P2P nodes, produces blocks and floods transactions through it,
+ * and reports how fast and at what cost they propagate.
+ *
+ * With --mode=simulated the nodes share a simulated_network, which delivers every broadcast
+ * directly to each node over a link with the given latency, bandwidth and loss.
+ * With --mode=loopback every node is a real graphene::network::node listening on 127.0.0.1,
+ * so the whole relay, sync and caching code runs; there --bandwidth limits each node's total
+ * upload and download, latency and loss are whatever loopback gives.
+ *
+ * Blocks are produced by the first node, transactions originate at random nodes. Nodes only
+ * keep blocks and transactions in memory, nothing is validated.
+ */
+
+#include <graphene/network/node.hpp>
+#include <graphene/network/core_messages.hpp>
+#include <graphene/protocol/operations.hpp>
+
+#include <fc/thread/thread.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace graphene::network;
+using graphene::protocol::block_id_type;
+using graphene::protocol::block_header;
+using graphene::protocol::signed_block;
+using graphene::protocol::signed_block_header;
+using graphene::protocol::signed_transaction;
+using graphene::protocol::custom_operation;
+
+namespace bpo = boost::program_options;
+
+/** Collects the arrival of every item at every node, shared by all nodes */
+class propagation_statistics {
+public:
+    void item_created(const item_hash_t &id, uint32_t origin, bool is_block) {
+        std::lock_guard<std::mutex> lock(mutex);
+        items[id] = item_origin{fc::time_point::now(), origin, is_block};
+        (is_block ? blocks_created : transactions_created) += 1;
+    }
+
+    void item_received(const item_hash_t &id, uint32_t node_index, uint32_t size) {
+        fc::time_point now = fc::time_point::now();
+        std::lock_guard<std::mutex> lock(mutex);
+        auto itr = items.find(id);
+        if (itr == items.end() || itr->second.origin == node_index) {
+            return;
+        }
+        auto &latencies = itr->second.is_block ? block_latencies : transaction_latencies;
+        latencies.push_back((now - itr->second.created).count());
+        delivered_bytes += size;
+    }
+
+    void duplicate_received(uint32_t node_index, const item_hash_t &id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto itr = items.find(id);
+        if (itr != items.end() && itr->second.origin == node_index) {
+            return;
+        }
+        ++duplicates;
+    }
+
+    struct item_origin {
+        fc::time_point created;
+        uint32_t origin;
+        bool is_block;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<item_hash_t, item_origin, std::hash<fc::ripemd160>> items;
+    std::vector<int64_t> block_latencies;
+    std::vector<int64_t> transaction_latencies;
+    uint64_t blocks_created = 0;
+    uint64_t transactions_created = 0;
+    uint64_t duplicates = 0;
+    uint64_t delivered_bytes = 0;
+};
+
+/** Keeps a linear chain and the transactions of one node in memory */
+class benchmark_delegate : public node_delegate {
+public:
+    benchmark_delegate(uint32_t index, propagation_statistics &statistics)
+            : index(index), statistics(statistics) {
+    }
+
+    bool has_item(const item_id &id) override {
+        if (id.item_type == block_message_type) {
+            return block_nums.count(id.item_hash) != 0;
+        }
+        return transactions.count(id.item_hash) != 0;
+    }
+
+    bool handle_block(const block_message &blk_msg, bool, std::vector<fc::uint160_t> &) override {
+        if (block_nums.count(blk_msg.block_id)) {
+            statistics.duplicate_received(index, blk_msg.block_id);
+            return false;
+        }
+        FC_ASSERT(blk_msg.block.previous == get_head_block_id(), "block doesn't link to our head block");
+        push_block(blk_msg.block, blk_msg.block_id);
+        statistics.item_received(blk_msg.block_id, index, (uint32_t)fc::raw::pack_size(blk_msg));
+        return false;
+    }
+
+    void prevalidate_sync_blocks(const std::vector<signed_block_header> &) override {
+    }
+
+    void prevalidate_block_for_relay(const block_message &blk_msg) override {
+        FC_ASSERT(blk_msg.block.previous == get_head_block_id(), "block doesn't link to our head block");
+    }
+
+    void handle_transaction(const trx_message &trx_msg) override {
+        message msg(trx_msg);
+        item_hash_t id = msg.id();
+        if (!transactions.emplace(id, msg).second) {
+            statistics.duplicate_received(index, id);
+            return;
+        }
+        statistics.item_received(id, index, msg.size);
+    }
+
+    void handle_message(const message &) override {
+    }
+
+    std::vector<item_hash_t> get_block_ids(const std::vector<item_hash_t> &blockchain_synopsis,
+            uint32_t &remaining_item_count, uint32_t limit) override {
+        std::vector<item_hash_t> result;
+        remaining_item_count = 0;
+        if (blocks.empty()) {
+            return result;
+        }
+
+        uint32_t first_block_num = 0;
+        for (auto itr = blockchain_synopsis.rbegin(); itr != blockchain_synopsis.rend(); ++itr) {
+            if (*itr == item_hash_t() || block_nums.count(*itr)) {
+                first_block_num = block_header::num_from_id(*itr);
+                break;
+            }
+        }
+
+        for (uint32_t num = std::max<uint32_t>(first_block_num, 1); num <= blocks.size() && result.size() < limit; ++num) {
+            result.push_back(block_ids[num - 1]);
+        }
+        if (!result.empty()) {
+            remaining_item_count = (uint32_t)blocks.size() - block_header::num_from_id(result.back());
+        }
+        return result;
+    }
+
+    message get_item(const item_id &id) override {
+        if (id.item_type == block_message_type) {
+            auto itr = block_nums.find(id.item_hash);
+            FC_ASSERT(itr != block_nums.end());
+            return block_message(blocks[itr->second - 1]);
+        }
+        auto itr = transactions.find(id.item_hash);
+        FC_ASSERT(itr != transactions.end());
+        return itr->second;
+    }
+
+    std::vector<message> get_block_range(const item_hash_t &first_block, uint32_t count) override {
+        std::vector<message> result;
+        auto itr = block_nums.find(first_block);
+        if (itr == block_nums.end()) {
+            return result;
+        }
+        for (uint32_t num = itr->second; num <= blocks.size() && result.size() < count; ++num) {
+            result.emplace_back(block_message(blocks[num - 1]));
+        }
+        return result;
+    }
+
+    std::vector<item_hash_t> get_blockchain_synopsis(const item_hash_t &reference_point, uint32_t) override {
+        std::vector<item_hash_t> synopsis;
+        uint32_t high_block_num = reference_point == item_hash_t() ? (uint32_t)blocks.size()
+                                                                   : block_header::num_from_id(reference_point);
+        high_block_num = std::min<uint32_t>(high_block_num, (uint32_t)blocks.size());
+        for (uint32_t distance = 0; distance < high_block_num; distance = distance ? distance * 2 : 1) {
+            synopsis.push_back(block_ids[high_block_num - distance - 1]);
+        }
+        std::reverse(synopsis.begin(), synopsis.end());
+        return synopsis;
+    }
+
+    void sync_status(uint32_t, uint32_t) override {
+    }
+
+    void connection_count_changed(uint32_t) override {
+    }
+
+    uint32_t get_block_number(const item_hash_t &block_id) override {
+        return block_header::num_from_id(block_id);
+    }
+
+    fc::time_point_sec get_block_time(const item_hash_t &block_id) override {
+        auto itr = block_nums.find(block_id);
+        if (itr == block_nums.end()) {
+            return fc::time_point_sec::min();
+        }
+        return blocks[itr->second - 1].timestamp;
+    }
+
+    fc::time_point_sec get_blockchain_now() override {
+        return fc::time_point::now();
+    }
+
+    item_hash_t get_head_block_id() const override {
+        return block_ids.empty() ? item_hash_t() : block_ids.back();
+    }
+
+    uint32_t estimate_last_known_fork_from_git_revision_timestamp(uint32_t) const override {
+        return 0;
+    }
+
+    void error_encountered(const std::string &, const fc::oexception &) override {
+    }
+
+    block_message produce_block(std::vector<signed_transaction> &&transactions_to_include) {
+        signed_block block;
+        block.previous = get_head_block_id();
+        block.timestamp = fc::time_point::now();
+        block.witness = "producer";
+        block.transactions = std::move(transactions_to_include);
+        block_message msg(block);
+        push_block(block, msg.block_id);
+        statistics.item_created(msg.block_id, index, true);
+        return msg;
+    }
+
+    trx_message create_transaction(uint32_t sequence, uint32_t payload_size) {
+        custom_operation op;
+        op.required_regular_auths.insert("sender");
+        op.id = "benchmark";
+        op.json = "{\"sequence\":" + std::to_string(sequence) + ",\"payload\":\"" +
+                  std::string(payload_size, 'x') + "\"}";
+
+        signed_transaction trx;
+        trx.ref_block_prefix = sequence;
+        trx.expiration = fc::time_point::now() + fc::hours(1);
+        trx.operations.push_back(op);
+
+        trx_message trx_msg(trx);
+        message msg(trx_msg);
+        transactions.emplace(msg.id(), msg);
+        statistics.item_created(msg.id(), index, false);
+        return trx_msg;
+    }
+
+    const uint32_t index;
+    /// runs the callbacks of this node in loopback mode, so nodes don't wait for each other
+    std::unique_ptr<fc::thread> thread;
+
+private:
+    void push_block(const signed_block &block, const block_id_type &block_id) {
+        blocks.push_back(block);
+        block_ids.push_back(block_id);
+        block_nums[block_id] = (uint32_t)blocks.size();
+    }
+
+    propagation_statistics &statistics;
+    std::vector<signed_block> blocks;
+    std::vector<block_id_type> block_ids;
+    std::unordered_map<item_hash_t, uint32_t, std::hash<fc::ripemd160>> block_nums;
+    std::unordered_map<item_hash_t, message, std::hash<fc::ripemd160>> transactions;
+};
+
+template<typename Functor>
+auto run_on(benchmark_delegate &delegate, Functor &&f) -> decltype(f()) {
+    if (delegate.thread) {
+        return delegate.thread->async(std::forward<Functor>(f), "p2p_simulation").wait();
+    }
+    return f();
+}
+
+static void print_latencies(const std::string &name, std::vector<int64_t> &latencies, uint64_t created, uint32_t node_count) {
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t expected = created * (node_count - 1);
+    std::cout << name << ": " << created << " created, " << latencies.size() << " of " << expected << " deliveries";
+    if (!latencies.empty()) {
+        auto percentile = [&](double p) {
+            return latencies[std::min<size_t>(latencies.size() - 1, size_t(p * latencies.size()))] / 1000.0;
+        };
+        std::cout << ", latency ms p50 " << percentile(0.5) << " p90 " << percentile(0.9)
+                  << " p99 " << percentile(0.99) << " max " << latencies.back() / 1000.0;
+    }
+    std::cout << "\n";
+}
+
+int main(int argc, char **argv) {
+    try {
+        bpo::options_description options("p2p_simulation options");
+        options.add_options()
+            ("help,h", "Print this help message and exit.")
+            ("mode", bpo::value<std::string>()->default_value("simulated"), "simulated or loopback")
+            ("nodes", bpo::value<uint32_t>()->default_value(10), "Number of nodes")
+            ("peers", bpo::value<uint32_t>()->default_value(4), "Connections each node opens to earlier nodes (loopback)")
+            ("latency-ms", bpo::value<uint32_t>()->default_value(50), "One-way link latency (simulated)")
+            ("bandwidth", bpo::value<uint32_t>()->default_value(0), "Link bandwidth in bytes per second, 0 for unlimited")
+            ("loss", bpo::value<double>()->default_value(0), "Probability of losing a message (simulated)")
+            ("header-first-relay", bpo::bool_switch()->default_value(false), "Relay blocks before applying them (loopback)")
+            ("blocks", bpo::value<uint32_t>()->default_value(20), "Number of blocks to produce")
+            ("block-interval-ms", bpo::value<uint32_t>()->default_value(1000), "Time between blocks")
+            ("transactions-per-block", bpo::value<uint32_t>()->default_value(100), "Transactions flooded in each block interval")
+            ("transaction-size", bpo::value<uint32_t>()->default_value(200), "Payload bytes of each transaction")
+            ("drain-ms", bpo::value<uint32_t>()->default_value(5000), "Time to wait for deliveries after the last block")
+            ("seed", bpo::value<uint32_t>()->default_value(1), "Random seed, runs with the same seed make the same traffic");
+
+        bpo::variables_map args;
+        bpo::store(bpo::parse_command_line(argc, argv, options), args);
+        bpo::notify(args);
+        if (args.count("help")) {
+            std::cout << options << "\n";
+            return 0;
+        }
+
+        const std::string mode = args["mode"].as<std::string>();
+        const uint32_t node_count = args["nodes"].as<uint32_t>();
+        const uint32_t peers = args["peers"].as<uint32_t>();
+        const uint32_t bandwidth = args["bandwidth"].as<uint32_t>();
+        const uint32_t block_count = args["blocks"].as<uint32_t>();
+        const fc::microseconds block_interval = fc::milliseconds(args["block-interval-ms"].as<uint32_t>());
+        const uint32_t transactions_per_block = args["transactions-per-block"].as<uint32_t>();
+        const uint32_t transaction_size = args["transaction-size"].as<uint32_t>();
+        FC_ASSERT(mode == "simulated" || mode == "loopback", "Unknown mode ${mode}", ("mode", mode));
+        FC_ASSERT(node_count >= 2, "At least two nodes are needed");
+
+        std::mt19937 random_engine(args["seed"].as<uint32_t>());
+        propagation_statistics statistics;
+        std::vector<std::unique_ptr<benchmark_delegate>> delegates;
+        for (uint32_t i = 0; i < node_count; ++i) {
+            delegates.emplace_back(new benchmark_delegate(i, statistics));
+        }
+
+        std::shared_ptr<simulated_network> network;
+        std::vector<std::shared_ptr<node>> nodes;
+        fc::temp_directory data_dir;
+
+        if (mode == "simulated") {
+            network = std::make_shared<simulated_network>("p2p_simulation");
+            network->set_link_properties(fc::milliseconds(args["latency-ms"].as<uint32_t>()), bandwidth, args["loss"].as<double>());
+            for (auto &delegate : delegates) {
+                network->add_node_delegate(delegate.get());
+            }
+        } else {
+            for (uint32_t i = 0; i < node_count; ++i) {
+                benchmark_delegate &delegate = *delegates[i];
+                delegate.thread.reset(new fc::thread("p2p_simulation delegate " + std::to_string(i)));
+                auto new_node = std::make_shared<node>("p2p_simulation");
+                new_node->load_configuration(data_dir.path() / std::to_string(i));
+                // the node calls its delegate on the thread setting it
+                run_on(delegate, [&]() { new_node->set_node_delegate(&delegate); });
+                new_node->listen_on_endpoint(fc::ip::endpoint(fc::ip::address("127.0.0.1"), 0), false);
+                new_node->disable_peer_advertising();
+                if (bandwidth) {
+                    new_node->set_total_bandwidth_limit(bandwidth, bandwidth);
+                }
+                if (args["header-first-relay"].as<bool>()) {
+                    new_node->set_advanced_node_parameters(fc::variant_object("header_first_relay", fc::variant(true)));
+                }
+                new_node->listen_to_p2p_network();
+                new_node->connect_to_p2p_network();
+                new_node->sync_from(item_id(block_message_type, item_hash_t()), std::vector<uint32_t>());
+
+                std::vector<uint32_t> earlier_nodes(i);
+                for (uint32_t j = 0; j < i; ++j) {
+                    earlier_nodes[j] = j;
+                }
+                std::shuffle(earlier_nodes.begin(), earlier_nodes.end(), random_engine);
+                for (uint32_t j = 0; j < std::min<uint32_t>(peers, i); ++j) {
+                    new_node->connect_to_endpoint(nodes[earlier_nodes[j]]->get_actual_listening_endpoint());
+                }
+                nodes.push_back(new_node);
+            }
+            // let the handshakes finish before measuring
+            fc::usleep(fc::seconds(2));
+        }
+
+        auto broadcast = [&](uint32_t node_index, const message &item) {
+            if (network) {
+                network->broadcast(item);
+            } else {
+                nodes[node_index]->broadcast(item);
+            }
+        };
+
+        std::uniform_int_distribution<uint32_t> random_node(0, node_count - 1);
+        std::clock_t cpu_start = std::clock();
+        fc::time_point start = fc::time_point::now();
+        uint32_t transaction_sequence = 0;
+
+        for (uint32_t block_index = 0; block_index < block_count; ++block_index) {
+            fc::time_point block_time = start + fc::microseconds(block_interval.count() * (block_index + 1));
+            std::vector<signed_transaction> block_transactions;
+            for (uint32_t i = 0; i < transactions_per_block; ++i) {
+                // spread the transactions over the block interval
+                fc::time_point send_time = block_time - block_interval +
+                        fc::microseconds(block_interval.count() * i / std::max<uint32_t>(transactions_per_block, 1));
+                if (send_time > fc::time_point::now()) {
+                    fc::usleep(send_time - fc::time_point::now());
+                }
+                uint32_t origin = random_node(random_engine);
+                uint32_t sequence = ++transaction_sequence;
+                trx_message trx_msg = run_on(*delegates[origin], [&]() {
+                    return delegates[origin]->create_transaction(sequence, transaction_size);
+                });
+                block_transactions.push_back(trx_msg.trx);
+                broadcast(origin, trx_msg);
+            }
+
+            if (block_time > fc::time_point::now()) {
+                fc::usleep(block_time - fc::time_point::now());
+            }
+            block_message block_msg = run_on(*delegates[0], [&]() {
+                return delegates[0]->produce_block(std::move(block_transactions));
+            });
+            broadcast(0, block_msg);
+        }
+
+        fc::usleep(fc::milliseconds(args["drain-ms"].as<uint32_t>()));
+        double wall_seconds = (fc::time_point::now() - start).count() / 1000000.0;
+        double cpu_seconds = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+        uint64_t bytes_sent = 0;
+        for (const auto &n : nodes) {
+            for (const peer_status &status : n->get_connected_peers()) {
+                bytes_sent += status.info["bytessent"].as_uint64();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(statistics.mutex);
+        std::cout << std::fixed << std::setprecision(2)
+                  << "mode: " << mode << ", " << node_count << " nodes, " << wall_seconds << " s\n";
+        print_latencies("blocks", statistics.block_latencies, statistics.blocks_created, node_count);
+        print_latencies("transactions", statistics.transaction_latencies, statistics.transactions_created, node_count);
+        uint64_t deliveries = statistics.block_latencies.size() + statistics.transaction_latencies.size();
+        std::cout << "duplicates: " << statistics.duplicates << " ("
+                  << (deliveries ? 100.0 * statistics.duplicates / deliveries : 0.0) << "% of deliveries)\n";
+        if (!nodes.empty() && statistics.delivered_bytes) {
+            std::cout << "bytes sent: " << bytes_sent << ", "
+                      << double(bytes_sent) / statistics.delivered_bytes << " per delivered payload byte\n";
+        }
+        std::cout << "cpu: " << cpu_seconds << " s, " << cpu_seconds / node_count << " s per node\n";
+
+        for (auto &n : nodes) {
+            n->close();
+        }
+        nodes.clear();
+        network.reset();
+        for (auto &delegate : delegates) {
+            if (delegate->thread) {
+                delegate->thread->quit();
+            }
+        }
+    }
+    catch (const fc::exception &e) {
+        edump((e.to_detail_string()));
+        return 1;
+    }
+    catch (const std::exception &e) {
+        edump((std::string(e.what())));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * Measures how fast encrypted P2P messages pass between two connections over loopback.
+ * Run it on two builds to compare them: MB/s is the wall clock throughput, MB per CPU second
+ * shows how much of a core sending and receiving the messages take.
+ *
+ * Usage: p2p_throughput [message size in bytes] [number of messages] [decode threads]
+ */
+
+#include <graphene/network/message_oriented_connection.hpp>
+#include <graphene/network/core_messages.hpp>
+
+#include <fc/network/tcp_socket.hpp>
+#include <fc/network/ip.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/crypto/rand.hpp>
+
+#include <ctime>
+#include <iostream>
+#include <string>
+
+using namespace graphene::network;
+
+class counting_receiver : public message_oriented_connection_delegate {
+public:
+    counting_receiver(uint32_t expected_messages)
+            : expected_messages(expected_messages),
+              done(new fc::promise<void>("p2p_throughput receiver")) {
+    }
+
+    void on_message(message_oriented_connection *, const message &received_message) override {
+        received_bytes += received_message.size;
+        if (++received_messages == expected_messages) {
+            done->set_value();
+        }
+    }
+
+    void on_connection_closed(message_oriented_connection *) override {
+        if (received_messages != expected_messages) {
+            done->set_exception(fc::exception_ptr(new FC_EXCEPTION(fc::eof_exception, "connection closed")));
+        }
+    }
+
+    uint32_t expected_messages;
+    uint32_t received_messages = 0;
+    uint64_t received_bytes = 0;
+    fc::promise<void>::ptr done;
+};
+
+class ignoring_sender : public message_oriented_connection_delegate {
+public:
+    void on_message(message_oriented_connection *, const message &) override {
+    }
+
+    void on_connection_closed(message_oriented_connection *) override {
+    }
+};
+
+int main(int argc, char **argv) {
+    try {
+        uint32_t message_size = argc > 1 ? std::stoul(argv[1]) : 1024 * 1024;
+        uint32_t message_count = argc > 2 ? std::stoul(argv[2]) : 1000;
+        uint32_t decode_threads = argc > 3 ? std::stoul(argv[3]) : 0;
+        FC_ASSERT(message_size > 0 && message_size <= MAX_MESSAGE_SIZE);
+        FC_ASSERT(message_count > 0);
+
+        message_oriented_connection::set_decode_thread_count(decode_threads);
+
+        counting_receiver receiver_delegate(message_count);
+        ignoring_sender sender_delegate;
+        message_oriented_connection receiver(&receiver_delegate);
+        message_oriented_connection sender(&sender_delegate);
+
+        fc::tcp_server server;
+        server.listen(fc::ip::endpoint(fc::ip::address("127.0.0.1"), 0));
+        fc::future<void> accepted = fc::async([&]() {
+            server.accept(receiver.get_socket());
+            receiver.accept();
+        }, "p2p_throughput accept");
+        sender.connect_to(fc::ip::endpoint(fc::ip::address("127.0.0.1"), server.get_port()));
+        accepted.wait();
+
+        message message_to_send;
+        message_to_send.msg_type = block_message_type;
+        message_to_send.size = message_size;
+        message_to_send.data.resize(message_size);
+        fc::rand_pseudo_bytes(message_to_send.data.data(), message_size);
+
+        std::clock_t cpu_start = std::clock();
+        fc::time_point wall_start = fc::time_point::now();
+
+        fc::future<void> sent = fc::async([&]() {
+            for (uint32_t i = 0; i < message_count; ++i) {
+                sender.send_message(message_to_send);
+            }
+        }, "p2p_throughput send");
+        receiver_delegate.done->wait();
+        sent.wait();
+
+        double wall_seconds = (fc::time_point::now() - wall_start).count() / 1000000.0;
+        double cpu_seconds = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+        double megabytes = receiver_delegate.received_bytes / (1024.0 * 1024.0);
+
+        std::cout << "messages:            " << message_count << " x " << message_size << " bytes\n"
+                  << "decode threads:      " << decode_threads << "\n"
+                  << "wall time:           " << wall_seconds << " s\n"
+                  << "cpu time:            " << cpu_seconds << " s\n"
+                  << "throughput:          " << megabytes / wall_seconds << " MB/s\n"
+                  << "per core:            " << megabytes / cpu_seconds << " MB per CPU second\n";
+
+        sender.close_connection();
+        receiver.close_connection();
+        sender.destroy_connection();
+        receiver.destroy_connection();
+        message_oriented_connection::set_decode_thread_count(0);
+    }
+    catch (const fc::exception &e) {
+        edump((e.to_detail_string()));
+        return 1;
+    }
+    catch (const std::exception &e) {
+        edump((std::string(e.what())));
+        return 1;
+    }
+
+    return 0;
+}
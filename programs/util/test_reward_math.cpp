@@ -0,0 +1,208 @@
+/**
+ * Checks fast_muldiv() against the u256 arithmetic it replaces and measures both.
+ *
+ * Operands are edge cases, random values of every bit width and, optionally, inputs recorded
+ * by a node: enable the "reward_math" logger at debug level (it writes "muldiv: a b c" lines
+ * for every reward and award claim), replay, and pass the log file here.
+ *
+ * Measure a release build: with asserts enabled fast_muldiv() checks every result with u256 itself.
+ *
+ * Usage: test_reward_math [random operands] [recorded log]
+ */
+
+#include <graphene/chain/reward_math.hpp>
+
+#include <fc/exception/exception.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace graphene::chain;
+using graphene::protocol::u256;
+
+struct muldiv_input {
+    int64_t a;
+    int64_t b;
+    fc::uint128_t c;
+};
+
+static uint64_t mismatches = 0;
+// keeps the measured calls from being optimized out
+static volatile uint64_t benchmark_sink = 0;
+static uint64_t fast_path_calls = 0;
+
+static bool reference_muldiv(const muldiv_input &input, uint64_t &result) {
+    if (input.a < 0 || input.b < 0 || input.c == fc::uint128_t()) {
+        return false;
+    }
+    u256 quotient = u256(input.a) * u256(input.b) / to256(input.c);
+    if (quotient > u256(uint64_t(std::numeric_limits<int64_t>::max()))) {
+        return false;
+    }
+    result = static_cast<uint64_t>(quotient);
+    return true;
+}
+
+/// The fast path has to give the same result, and fall back only when the result doesn't fit
+static void check(const muldiv_input &input) {
+    uint64_t expected = 0;
+    uint64_t result = 0;
+    bool fits = reference_muldiv(input, expected);
+    bool fast = fast_muldiv(input.a, input.b, input.c, result);
+    if (fast) {
+        ++fast_path_calls;
+    }
+
+#ifdef __SIZEOF_INT128__
+    if (fast != fits || (fast && result != expected)) {
+#else
+    if (fast) {
+#endif
+        if (++mismatches <= 20) {
+            std::cerr << "mismatch: " << input.a << " * " << input.b << " / " << std::string(input.c)
+                      << ": fast " << (fast ? std::to_string(result) : "fallback")
+                      << ", u256 " << (fits ? std::to_string(expected) : "doesn't fit") << "\n";
+        }
+    }
+}
+
+static std::vector<muldiv_input> edge_cases() {
+    const int64_t max = std::numeric_limits<int64_t>::max();
+    const std::vector<int64_t> values = {
+        0, 1, 2, 3, 1000, 0xffffffffLL, 0x100000000LL, 0x7fffffffffffLL, max / 3, max / 2, max - 1, max, -1
+    };
+    const std::vector<fc::uint128_t> divisors = {
+        fc::uint128_t(0), fc::uint128_t(1), fc::uint128_t(2), fc::uint128_t(3), fc::uint128_t(uint64_t(0xffffffff)),
+        fc::uint128_t(uint64_t(max)), fc::uint128_t(uint64_t(max) + 1), fc::uint128_t(~uint64_t(0)),
+        fc::uint128_t(1, 0), fc::uint128_t(1, 1), fc::uint128_t(0x3fffffffffffffffULL, ~uint64_t(0)),
+        fc::uint128_t(0x4000000000000000ULL, 0), fc::uint128_t(~uint64_t(0), ~uint64_t(0))
+    };
+
+    std::vector<muldiv_input> inputs;
+    for (auto a : values) {
+        for (auto b : values) {
+            for (const auto &c : divisors) {
+                inputs.push_back({a, b, c});
+            }
+        }
+    }
+    return inputs;
+}
+
+static std::vector<muldiv_input> random_inputs(uint64_t count) {
+    std::mt19937_64 generator(20200101);
+    auto random_bits = [&](uint32_t bits) -> uint64_t {
+        uint64_t value = generator();
+        return bits >= 64 ? value : value & ((uint64_t(1) << bits) - 1);
+    };
+
+    std::vector<muldiv_input> inputs;
+    inputs.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        // operands of every width, so both paths and the boundary between them are hit
+        int64_t a = random_bits(generator() % 64);
+        int64_t b = random_bits(generator() % 64);
+        uint32_t c_bits = generator() % 129;
+        fc::uint128_t c(c_bits > 64 ? random_bits(c_bits - 64) : 0, c_bits >= 64 ? generator() : random_bits(c_bits));
+        inputs.push_back({a, b, c});
+    }
+    return inputs;
+}
+
+static std::vector<muldiv_input> recorded_inputs(const std::string &path) {
+    std::ifstream log(path);
+    FC_ASSERT(log, "Can't open ${path}", ("path", path));
+
+    std::vector<muldiv_input> inputs;
+    std::string line;
+    while (std::getline(log, line)) {
+        auto pos = line.find("muldiv: ");
+        if (pos == std::string::npos) {
+            continue;
+        }
+
+        std::istringstream fields(line.substr(pos + 8));
+        muldiv_input input;
+        std::string c;
+        if (fields >> input.a >> input.b >> c) {
+            input.c = fc::uint128_t(c);
+            inputs.push_back(input);
+        }
+    }
+    return inputs;
+}
+
+template <typename Muldiv>
+static double nanoseconds_per_call(const std::vector<muldiv_input> &inputs, Muldiv &&muldiv) {
+    uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &input : inputs) {
+        checksum += muldiv(input);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    benchmark_sink = checksum;
+    return inputs.empty() ? 0 : elapsed.count() / inputs.size();
+}
+
+static void run(const std::string &name, const std::vector<muldiv_input> &inputs) {
+    mismatches = 0;
+    fast_path_calls = 0;
+    for (const auto &input : inputs) {
+        check(input);
+    }
+
+    // both paths measured on the operands the fast path takes, as the chain calls it
+    std::vector<muldiv_input> fast_inputs;
+    for (const auto &input : inputs) {
+        uint64_t result;
+        if (fast_muldiv(input.a, input.b, input.c, result)) {
+            fast_inputs.push_back(input);
+        }
+    }
+
+    double fast_ns = nanoseconds_per_call(fast_inputs, [](const muldiv_input &input) {
+        uint64_t result = 0;
+        fast_muldiv(input.a, input.b, input.c, result);
+        return result;
+    });
+    double u256_ns = nanoseconds_per_call(fast_inputs, [](const muldiv_input &input) {
+        return u256_muldiv(u256(input.a), u256(input.b), to256(input.c));
+    });
+
+    std::cout << name << ": " << inputs.size() << " inputs, " << fast_path_calls << " on the fast path, "
+              << mismatches << " mismatches\n"
+              << "    fast_muldiv: " << fast_ns << " ns per call, u256_muldiv: " << u256_ns << " ns per call\n";
+}
+
+int main(int argc, char **argv) {
+    try {
+        uint64_t random_count = argc > 1 ? std::stoull(argv[1]) : 10000000;
+        uint64_t total_mismatches = 0;
+
+        run("edge cases", edge_cases());
+        total_mismatches += mismatches;
+
+        run("random", random_inputs(random_count));
+        total_mismatches += mismatches;
+
+        if (argc > 2) {
+            run("recorded", recorded_inputs(argv[2]));
+            total_mismatches += mismatches;
+        }
+
+        return total_mismatches == 0 ? 0 : 1;
+    }
+    catch (const fc::exception &e) {
+        edump((e.to_detail_string()));
+        return 1;
+    }
+    catch (const std::exception &e) {
+        edump((std::string(e.what())));
+        return 1;
+    }
+}